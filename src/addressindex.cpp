@@ -0,0 +1,97 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "clientversion.h"
+#include "crypto/sha256.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "utilstrencodings.h"
+
+uint256 GetScriptHash(const CScript& scriptPubKey)
+{
+    uint256 hash;
+    CSHA256().Write(scriptPubKey.data(), scriptPubKey.size()).Finalize(hash.begin());
+    return hash;
+}
+
+void GetAddressIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect, CAddressIndexUpdate& update)
+{
+    update.vHistory.clear();
+    update.vUnspent.clear();
+
+    // Unspent outputs are added and removed in the order the block spends
+    // them, or in reverse when it is disconnected, so that outputs spent
+    // within the block end up removed either way.
+    for (unsigned int k = 0; k < block.vtx.size(); k++) {
+        const unsigned int i = fConnect ? k : block.vtx.size() - 1 - k;
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        if (!fConnect) {
+            for (unsigned int n = 0; n < tx.vout.size(); n++) {
+                const CTxOut& out = tx.vout[n];
+                if (out.scriptPubKey.IsUnspendable())
+                    continue;
+                update.vUnspent.emplace_back(CAddressUnspentKey(GetScriptHash(out.scriptPubKey), nHeight, txid, n), CAddressUnspentValue());
+            }
+        }
+
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const Coin& coin = txundo.vprevout[j];
+                const uint256 hashScript = GetScriptHash(coin.out.scriptPubKey);
+                update.vHistory.emplace_back(CAddressIndexKey(hashScript, nHeight, i, true, j), CAddressIndexValue(txid, coin.out.nValue));
+                update.vUnspent.emplace_back(CAddressUnspentKey(hashScript, coin.nHeight, prevout.hash, prevout.n),
+                                             fConnect ? CAddressUnspentValue() : CAddressUnspentValue(coin.out.nValue, coin.fCoinBase));
+            }
+        }
+
+        for (unsigned int n = 0; n < tx.vout.size(); n++) {
+            const CTxOut& out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable())
+                continue;
+            const uint256 hashScript = GetScriptHash(out.scriptPubKey);
+            update.vHistory.emplace_back(CAddressIndexKey(hashScript, nHeight, i, false, n), CAddressIndexValue(txid, out.nValue));
+            if (fConnect)
+                update.vUnspent.emplace_back(CAddressUnspentKey(hashScript, nHeight, txid, n), CAddressUnspentValue(out.nValue, i == 0));
+        }
+    }
+}
+
+template<typename Key>
+static std::string EncodeCursor(const Key& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    // The script hash is known to whoever asks
+    return HexStr(ss.begin() + sizeof(uint256), ss.end());
+}
+
+template<typename Key>
+static bool DecodeCursor(const std::string& strCursor, Key& key)
+{
+    if (!IsHex(strCursor))
+        return false;
+    std::vector<unsigned char> vch = ParseHex(strCursor);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key.hashScript;
+    ss.write((const char*)vch.data(), vch.size());
+    try {
+        ss >> key;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return ss.empty();
+}
+
+std::string EncodeAddressIndexCursor(const CAddressIndexKey& key) { return EncodeCursor(key); }
+std::string EncodeAddressIndexCursor(const CAddressUnspentKey& key) { return EncodeCursor(key); }
+bool DecodeAddressIndexCursor(const std::string& strCursor, CAddressIndexKey& key) { return DecodeCursor(strCursor, key); }
+bool DecodeAddressIndexCursor(const std::string& strCursor, CAddressUnspentKey& key) { return DecodeCursor(strCursor, key); }
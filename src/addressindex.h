@@ -0,0 +1,159 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+class CScript;
+
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Number of address index entries returned per page by default */
+static const unsigned int DEFAULT_ADDRESS_INDEX_PAGE = 1000;
+/** Maximum number of address index entries returned per page */
+static const unsigned int MAX_ADDRESS_INDEX_PAGE = 10000;
+
+/** The key the address index files a scriptPubKey under: its SHA256, as
+ *  the Electrum protocol uses. */
+uint256 GetScriptHash(const CScript& scriptPubKey);
+
+/**
+ * An output paid to, or an input spending from, a script in a block.
+ * Serialized big-endian, so that the entries of a script are kept in
+ * chain order.
+ */
+struct CAddressIndexKey
+{
+    uint256 hashScript;
+    int nHeight;
+    //! Position of the transaction in the block
+    unsigned int nTxPos;
+    //! Whether this is an input spending from the script rather than an
+    //! output paying to it
+    bool fSpending;
+    //! Index of the output or input in the transaction
+    unsigned int nIndex;
+
+    CAddressIndexKey() : nHeight(0), nTxPos(0), fSpending(false), nIndex(0) {}
+    CAddressIndexKey(const uint256& hashScriptIn, int nHeightIn, unsigned int nTxPosIn, bool fSpendingIn, unsigned int nIndexIn) :
+        hashScript(hashScriptIn), nHeight(nHeightIn), nTxPos(nTxPosIn), fSpending(fSpendingIn), nIndex(nIndexIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << hashScript;
+        ser_writedata32be(s, nHeight);
+        ser_writedata32be(s, nTxPos);
+        ser_writedata8(s, fSpending);
+        ser_writedata32be(s, nIndex);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> hashScript;
+        nHeight = ser_readdata32be(s);
+        nTxPos = ser_readdata32be(s);
+        fSpending = ser_readdata8(s);
+        nIndex = ser_readdata32be(s);
+    }
+};
+
+struct CAddressIndexValue
+{
+    uint256 txid;
+    //! Value of the output, or of the output the input spends
+    CAmount nValue;
+
+    CAddressIndexValue() : nValue(0) {}
+    CAddressIndexValue(const uint256& txidIn, CAmount nValueIn) : txid(txidIn), nValue(nValueIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(nValue);
+    }
+};
+
+/** An unspent output paying to a script, in the order of the blocks */
+struct CAddressUnspentKey
+{
+    uint256 hashScript;
+    int nHeight;
+    uint256 txid;
+    unsigned int n;
+
+    CAddressUnspentKey() : nHeight(0), n(0) {}
+    CAddressUnspentKey(const uint256& hashScriptIn, int nHeightIn, const uint256& txidIn, unsigned int nIn) :
+        hashScript(hashScriptIn), nHeight(nHeightIn), txid(txidIn), n(nIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << hashScript;
+        ser_writedata32be(s, nHeight);
+        s << txid;
+        ser_writedata32be(s, n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> hashScript;
+        nHeight = ser_readdata32be(s);
+        s >> txid;
+        n = ser_readdata32be(s);
+    }
+};
+
+struct CAddressUnspentValue
+{
+    CAmount nValue;
+    bool fCoinBase;
+
+    CAddressUnspentValue() : nValue(-1), fCoinBase(false) {}
+    CAddressUnspentValue(CAmount nValueIn, bool fCoinBaseIn) : nValue(nValueIn), fCoinBase(fCoinBaseIn) {}
+
+    bool IsNull() const { return nValue == -1; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nValue);
+        READWRITE(fCoinBase);
+    }
+};
+
+/** The changes connecting or disconnecting a block makes to the address index */
+struct CAddressIndexUpdate
+{
+    //! History entries the block adds, or removes when it is disconnected
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vHistory;
+    //! Unspent outputs to add, or to remove where the value is null, in order
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+};
+
+/**
+ * Collect the address index changes of connecting block at nHeight, or of
+ * disconnecting it, from the block and its undo data.
+ */
+void GetAddressIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect, CAddressIndexUpdate& update);
+
+/** Encode where a page of history or unspent outputs continues, without the script hash. */
+std::string EncodeAddressIndexCursor(const CAddressIndexKey& key);
+std::string EncodeAddressIndexCursor(const CAddressUnspentKey& key);
+/** Decode a cursor into key, whose script hash must be set already. */
+bool DecodeAddressIndexCursor(const std::string& strCursor, CAddressIndexKey& key);
+bool DecodeAddressIndexCursor(const std::string& strCursor, CAddressUnspentKey& key);
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,160 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "auxpowcache.h"
+
+#include "auxpow.h"
+#include "memusage.h"
+#include "streams.h"
+#include "util.h"
+#include "version.h"
+
+CAuxPowCache auxpowCache;
+
+CAuxPowCache::CAuxPowCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0), nHits(0), nMisses(0)
+{
+}
+
+size_t CAuxPowCache::EntryUsage(const CacheEntry& entry)
+{
+    // List node (two pointers plus the entry) and hash map node (key, iterator
+    // and a next pointer), plus the serialized auxpow itself.
+    return memusage::MallocUsage(sizeof(CacheEntry) + 2 * sizeof(void*)) +
+           memusage::MallocUsage(sizeof(uint256) + sizeof(entry_list::iterator) + sizeof(void*)) +
+           memusage::DynamicUsage(entry.vchAuxPow);
+}
+
+void CAuxPowCache::EvictLocked(size_t nTarget)
+{
+    while (!listEntries.empty() && nUsage + memusage::MallocUsage(sizeof(void*) * mapEntries.bucket_count()) > nTarget) {
+        const CacheEntry& entry = listEntries.back();
+        nUsage -= EntryUsage(entry);
+        mapEntries.erase(entry.hash);
+        listEntries.pop_back();
+    }
+}
+
+void CAuxPowCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    EvictLocked(nMaxUsage);
+}
+
+void CAuxPowCache::Insert(const uint256& hash, const CAuxPow& auxpow, bool fChecked)
+{
+    LOCK(cs);
+    if (nMaxUsage == 0)
+        return;
+
+    entry_map::iterator it = mapEntries.find(hash);
+    if (it != mapEntries.end()) {
+        // The auxpow for a given block hash is not covered by the hash, but
+        // whatever was stored first has already been accepted; only refresh
+        // its position and checked state.
+        it->second->fChecked |= fChecked;
+        listEntries.splice(listEntries.begin(), listEntries, it->second);
+        return;
+    }
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << auxpow;
+
+    CacheEntry entry;
+    entry.hash = hash;
+    entry.vchAuxPow.assign(ss.begin(), ss.end());
+    entry.fChecked = fChecked;
+
+    const size_t nEntryUsage = EntryUsage(entry);
+    if (nEntryUsage > nMaxUsage)
+        return;
+    EvictLocked(nMaxUsage - nEntryUsage);
+
+    listEntries.push_front(std::move(entry));
+    mapEntries.emplace(hash, listEntries.begin());
+    nUsage += nEntryUsage;
+}
+
+bool CAuxPowCache::Lookup(const uint256& hash, boost::shared_ptr<CAuxPow>& auxpow, bool& fChecked)
+{
+    LOCK(cs);
+    entry_map::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end()) {
+        ++nMisses;
+        return false;
+    }
+
+    const CacheEntry& entry = *it->second;
+    boost::shared_ptr<CAuxPow> result(new CAuxPow());
+    try {
+        CDataStream ss(entry.vchAuxPow, SER_DISK, PROTOCOL_VERSION);
+        ss >> *result;
+    } catch (const std::exception& e) {
+        // Should never happen, as we serialized the entry ourselves.
+        LogPrintf("%s: Deserialize error for %s: %s\n", __func__, hash.ToString(), e.what());
+        nUsage -= EntryUsage(entry);
+        listEntries.erase(it->second);
+        mapEntries.erase(it);
+        ++nMisses;
+        return false;
+    }
+
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    auxpow = result;
+    fChecked = entry.fChecked;
+    ++nHits;
+    return true;
+}
+
+void CAuxPowCache::Erase(const uint256& hash)
+{
+    LOCK(cs);
+    entry_map::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return;
+    nUsage -= EntryUsage(*it->second);
+    listEntries.erase(it->second);
+    mapEntries.erase(it);
+}
+
+void CAuxPowCache::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapEntries.clear();
+    nUsage = 0;
+}
+
+size_t CAuxPowCache::Size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+size_t CAuxPowCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage + memusage::MallocUsage(sizeof(void*) * mapEntries.bucket_count());
+}
+
+uint64_t CAuxPowCache::GetHits() const
+{
+    LOCK(cs);
+    return nHits;
+}
+
+uint64_t CAuxPowCache::GetMisses() const
+{
+    LOCK(cs);
+    return nMisses;
+}
+
+void InitAuxPowCache()
+{
+    // nMaxUsage is unsigned. If -auxpowcache is set to zero, the cache is
+    // disabled and every auxpow header is read from disk again.
+    size_t nMaxUsage = std::min(std::max((int64_t)0, GetArg("-auxpowcache", DEFAULT_AUXPOW_CACHE_SIZE)), MAX_AUXPOW_CACHE_SIZE) * ((size_t) 1 << 20);
+    auxpowCache.SetMaxUsage(nMaxUsage);
+    LogPrintf("Using %zu MiB for the auxpow header cache\n", nMaxUsage >> 20);
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_AUXPOWCACHE_H
+#define BITCOIN_AUXPOWCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+class CAuxPow;
+
+/** Default for -auxpowcache, in MiB. */
+static const unsigned int DEFAULT_AUXPOW_CACHE_SIZE = 64;
+/** Maximum allowed -auxpowcache, in MiB. */
+static const int64_t MAX_AUXPOW_CACHE_SIZE = 16384;
+
+/**
+ * Bounded, memory-accounted cache of the auxpow data belonging to block
+ * headers in the block index.
+ *
+ * CBlockIndex does not keep the auxpow of merge-mined blocks, so building a
+ * full CBlockHeader for one used to require a read from the block files.
+ * Entries are kept in their compact serialized form and evicted in
+ * least-recently-used order once the configured memory limit is reached.
+ */
+class CAuxPowCache
+{
+private:
+    struct CacheEntry {
+        uint256 hash;
+        std::vector<unsigned char> vchAuxPow;
+        //! Whether the PoW of the header was checked when this entry was added
+        bool fChecked;
+    };
+
+    struct CacheEntryHasher {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    typedef std::list<CacheEntry> entry_list;
+    typedef std::unordered_map<uint256, entry_list::iterator, CacheEntryHasher> entry_map;
+
+    mutable CCriticalSection cs;
+    //! Entries in least-recently-used order, most recent at the front
+    entry_list listEntries;
+    entry_map mapEntries;
+    size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    static size_t EntryUsage(const CacheEntry& entry);
+    void EvictLocked(size_t nTarget);
+
+public:
+    explicit CAuxPowCache(size_t nMaxUsageIn = (size_t)DEFAULT_AUXPOW_CACHE_SIZE << 20);
+
+    /** Change the memory limit (in bytes), evicting entries as needed. */
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    /**
+     * Store the auxpow of the block with the given hash.
+     * @param hash Hash of the merge-mined block.
+     * @param auxpow The block's auxpow.
+     * @param fChecked Whether the header's PoW was already verified.
+     */
+    void Insert(const uint256& hash, const CAuxPow& auxpow, bool fChecked);
+
+    /**
+     * Look up the auxpow of the block with the given hash.
+     * @param hash Hash of the merge-mined block.
+     * @param auxpow Set to a freshly deserialized copy of the auxpow on success.
+     * @param fChecked Set to whether the header's PoW was verified.
+     * @return True if the entry was found.
+     */
+    bool Lookup(const uint256& hash, boost::shared_ptr<CAuxPow>& auxpow, bool& fChecked);
+
+    void Erase(const uint256& hash);
+    void Clear();
+
+    size_t Size() const;
+    size_t DynamicMemoryUsage() const;
+    uint64_t GetHits() const;
+    uint64_t GetMisses() const;
+};
+
+/** Global cache of auxpow data for headers in mapBlockIndex. */
+extern CAuxPowCache auxpowCache;
+
+/** Size the global auxpow cache according to -auxpowcache. */
+void InitAuxPowCache();
+
+#endif // BITCOIN_AUXPOWCACHE_H
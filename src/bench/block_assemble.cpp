@@ -0,0 +1,155 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "miner.h"
+#include "pow.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/filesystem.hpp>
+
+// The mempool holds SPLIT_TXS * OUTPUTS_PER_SPLIT independent transactions,
+// which all fit in one block.
+static const int SPLIT_TXS = 40;
+static const int OUTPUTS_PER_SPLIT = 100;
+
+/** Mine a block with vtx on top of the tip, paying to OP_TRUE */
+static CBlock MineBlock(const std::vector<CTransactionRef>& vtx)
+{
+    const CChainParams& chainparams = Params();
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(CScript() << OP_TRUE, false);
+    CBlock& block = pblocktemplate->block;
+    block.vtx.resize(1);
+    block.vtx.insert(block.vtx.end(), vtx.begin(), vtx.end());
+    unsigned int nExtraNonce = 0;
+    IncrementExtraNonce(&block, chainActive.Tip(), nExtraNonce);
+    while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, chainparams.GetConsensus(0))) ++block.nNonce;
+
+    bool fProcessed = ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, NULL);
+    assert(fProcessed && chainActive.Tip()->GetBlockHash() == block.GetHash());
+    return block;
+}
+
+static CTransactionRef Spend(const COutPoint& prevout, const std::vector<CAmount>& vValues)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    for (CAmount nValue : vValues)
+        tx.vout.push_back(CTxOut(nValue, CScript() << OP_TRUE));
+    return MakeTransactionRef(tx);
+}
+
+/** A regtest chain in a temporary data directory, with the mempool full of
+  * transactions spending its outputs, and one spare transaction */
+class AssembleSetup
+{
+public:
+    boost::filesystem::path pathTemp;
+    CTransactionRef txSpare;
+    CAmount nSpareFee;
+    size_t nMempoolTxs;
+
+    AssembleSetup() : nSpareFee(0), nMempoolTxs(0)
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        InitSignatureCache();
+        InitScriptExecutionCache();
+        ClearDatadirCache();
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_dogecoin_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        boost::filesystem::create_directories(pathTemp);
+        ForceSetArg("-datadir", pathTemp.string());
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+        pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        InitBlockIndex(Params());
+        CValidationState state;
+        ActivateBestChain(state, Params());
+
+        // Mine coinbases until SPLIT_TXS of them are mature, and split those
+        std::vector<CTransactionRef> vCoinbase;
+        const int nMaturity = Params().GetConsensus(0).nCoinbaseMaturity;
+        for (int i = 0; i < SPLIT_TXS + nMaturity; i++)
+            vCoinbase.push_back(MineBlock(std::vector<CTransactionRef>()).vtx[0]);
+        std::vector<CTransactionRef> vSplit;
+        for (int i = 0; i < SPLIT_TXS; i++) {
+            const CAmount nValue = (vCoinbase[i]->vout[0].nValue - COIN) / OUTPUTS_PER_SPLIT;
+            vSplit.push_back(Spend(COutPoint(vCoinbase[i]->GetHash(), 0), std::vector<CAmount>(OUTPUTS_PER_SPLIT, nValue)));
+        }
+        MineBlock(vSplit);
+
+        LockPoints lp;
+        for (const CTransactionRef& split : vSplit) {
+            for (int n = 0; n < OUTPUTS_PER_SPLIT; n++) {
+                const CAmount nFee = COIN + GetRand(COIN);
+                CTransactionRef tx = Spend(COutPoint(split->GetHash(), n), std::vector<CAmount>(1, split->vout[n].nValue - nFee));
+                if (!txSpare) {
+                    txSpare = tx;
+                    nSpareFee = nFee;
+                    continue;
+                }
+                mempool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, nFee, 0, 0.0, chainActive.Height(), 0, false, 0, lp));
+                nMempoolTxs++;
+            }
+        }
+    }
+
+    ~AssembleSetup()
+    {
+        UnloadBlockIndex();
+        delete pcoinsTip;
+        delete pcoinsdbview;
+        delete pblocktree;
+        pcoinsTip = NULL;
+        pcoinsdbview = NULL;
+        pblocktree = NULL;
+        boost::filesystem::remove_all(pathTemp);
+        SelectParams(CBaseChainParams::MAIN);
+    }
+
+    void AddSpare()
+    {
+        LockPoints lp;
+        mempool.addUnchecked(txSpare->GetHash(), CTxMemPoolEntry(txSpare, nSpareFee, 0, 0.0, chainActive.Height(), 0, false, 0, lp));
+    }
+};
+
+// Assemble the block from scratch, like the mining RPCs did for every
+// template after the mempool changed.
+static void AssembleBlock(benchmark::State& state)
+{
+    AssembleSetup setup;
+    while (state.KeepRunning()) {
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(Params()).CreateNewBlock(CScript() << OP_TRUE, false);
+        assert(pblocktemplate->block.vtx.size() == setup.nMempoolTxs + 1);
+    }
+}
+
+// Serve a template after a transaction entered the mempool, and another one
+// after it left again, from a template that is kept up to date.
+static void AssembleBlockIncremental(benchmark::State& state)
+{
+    AssembleSetup setup;
+    CBlockTemplateBuilder builder(Params());
+    builder.GetBlockTemplate(CScript() << OP_TRUE, false, 60);
+    while (state.KeepRunning()) {
+        setup.AddSpare();
+        std::unique_ptr<CBlockTemplate> pblocktemplate = builder.GetBlockTemplate(CScript() << OP_TRUE, false, 60);
+        assert(pblocktemplate->block.vtx.size() == setup.nMempoolTxs + 2);
+        mempool.removeRecursive(*setup.txSpare);
+        pblocktemplate = builder.GetBlockTemplate(CScript() << OP_TRUE, false, 60);
+        assert(pblocktemplate->block.vtx.size() == setup.nMempoolTxs + 1);
+    }
+}
+
+BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockIncremental);
@@ -0,0 +1,81 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "crypto/common.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+
+// Measures how long block validation is held up by writing the UTXO cache
+// to the chainstate database. Every iteration connects a few simulated
+// blocks, each spending the outputs created one flush earlier (read back
+// from the database) and creating as many new ones, and then flushes the
+// cache: once writing synchronously and once handing the write to the
+// background flush thread, which overlaps it with the next blocks.
+static const uint32_t BLOCKS_PER_FLUSH = 10;
+static const uint32_t COINS_PER_BLOCK = 2000;
+
+static void CoinsFlush(benchmark::State& state, bool fBackground)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / strprintf("bench_dogecoin_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    boost::filesystem::create_directories(path);
+    ForceSetArg("-datadir", path.string());
+    ClearDatadirCache();
+
+    {
+        CCoinsViewDB db(1 << 23, true);
+        boost::thread_group threadGroup;
+        if (fBackground)
+            threadGroup.create_thread(boost::bind(&CCoinsViewDB::ThreadFlush, &db));
+
+        CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x42) << OP_EQUALVERIFY << OP_CHECKSIG;
+        CCoinsViewCache tip(&db);
+        uint32_t nHeight = 1;
+        while (state.KeepRunning()) {
+            for (uint32_t b = 0; b < BLOCKS_PER_FLUSH; b++, nHeight++) {
+                for (uint32_t i = 0; i < COINS_PER_BLOCK; i++) {
+                    uint256 txid;
+                    if (nHeight > BLOCKS_PER_FLUSH) {
+                        WriteLE32(txid.begin(), nHeight - BLOCKS_PER_FLUSH);
+                        WriteLE32(txid.begin() + 4, i);
+                        assert(tip.SpendCoin(COutPoint(txid, 0)));
+                    }
+                    WriteLE32(txid.begin(), nHeight);
+                    WriteLE32(txid.begin() + 4, i);
+                    Coin coin(CTxOut(i + 1, script), nHeight, false);
+                    tip.AddCoin(COutPoint(txid, 0), std::move(coin), false);
+                }
+                uint256 hashBlock;
+                WriteLE32(hashBlock.begin(), nHeight);
+                tip.SetBestBlock(hashBlock);
+            }
+            tip.Flush();
+        }
+        db.WaitForFlush();
+
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+
+    ClearDatadirCache();
+    boost::filesystem::remove_all(path);
+}
+
+static void CoinsFlushSync(benchmark::State& state)
+{
+    CoinsFlush(state, false);
+}
+
+static void CoinsFlushBackground(benchmark::State& state)
+{
+    CoinsFlush(state, true);
+}
+
+BENCHMARK(CoinsFlushSync);
+BENCHMARK(CoinsFlushBackground);
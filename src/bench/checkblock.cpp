@@ -8,6 +8,10 @@
 #include "validation.h"
 #include "streams.h"
 #include "consensus/validation.h"
+#include "policy/policy.h"
+#include "pubkey.h"
+#include "script/sigcache.h"
+#include "script/standard.h"
 
 namespace block_bench {
 #include "bench/data/block413567.raw.h"
@@ -45,10 +49,69 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
         stream >> block;
         assert(stream.Rewind(sizeof(block_bench::block413567)));
 
+        // The test block is a Bitcoin block, so its proof of work is not
+        // valid under Dogecoin's scrypt rules.
         CValidationState validationState;
-        assert(CheckBlock(block, validationState));
+        assert(CheckBlock(block, validationState, false));
     }
 }
 
+// The signature checks of ConnectBlock, minus the UTXO lookups: the outputs
+// spent by the pay-to-pubkey-hash inputs of the block are rebuilt from the
+// public keys in their scriptSigs (legacy signature hashes don't commit to
+// the amount).
+static void VerifyBlockScripts(benchmark::State& state, bool fPubKeyCache)
+{
+    ECCVerifyHandle verifyHandle;
+    InitSignatureCache();
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
+    std::vector<std::pair<CScript, std::pair<size_t, unsigned int> > > vInputs;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        txdata.emplace_back(tx);
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const CScript& scriptSig = tx.vin[j].scriptSig;
+            CScript::const_iterator pc = scriptSig.begin();
+            std::vector<unsigned char> vchSig, vchPubKey;
+            opcodetype opcode;
+            if (!scriptSig.GetOp(pc, opcode, vchSig) || !scriptSig.GetOp(pc, opcode, vchPubKey) || pc != scriptSig.end())
+                continue;
+            CPubKey pubkey(vchPubKey);
+            if (vchSig.empty() || !pubkey.IsFullyValid())
+                continue;
+            vInputs.push_back(std::make_pair(GetScriptForDestination(pubkey.GetID()), std::make_pair(i - 1, j)));
+        }
+    }
+    assert(vInputs.size() > 1000);
+
+    while (state.KeepRunning()) {
+        CPubKeyParseCache pubkeycache;
+        for (const auto& input : vInputs) {
+            const size_t nTx = input.second.first;
+            CScriptCheck check(input.first, 0, *block.vtx[nTx + 1], input.second.second, MANDATORY_SCRIPT_VERIFY_FLAGS, false, &txdata[nTx], fPubKeyCache ? &pubkeycache : NULL);
+            assert(check());
+        }
+    }
+}
+
+static void VerifyBlockScriptsTest(benchmark::State& state)
+{
+    VerifyBlockScripts(state, false);
+}
+
+static void VerifyBlockScriptsPubKeyCacheTest(benchmark::State& state)
+{
+    VerifyBlockScripts(state, true);
+}
+
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(VerifyBlockScriptsTest);
+BENCHMARK(VerifyBlockScriptsPubKeyCacheTest);
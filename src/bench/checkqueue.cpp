@@ -6,6 +6,7 @@
 #include "util.h"
 #include "validation.h"
 #include "checkqueue.h"
+#include "crypto/sha256.h"
 #include "prevector.h"
 #include <vector>
 #include <boost/thread/thread.hpp>
@@ -99,5 +100,57 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark shows how the CheckQueue scales with the number of threads
+// (counting the master), for checks that take a few microseconds each like
+// signature checks do, added a transaction at a time like ConnectBlock does.
+static const int HASHES_PER_JOB = 16;
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        unsigned char data[CSHA256::OUTPUT_SIZE];
+        HashJob() { memset(data, 0, sizeof(data)); }
+        bool operator()()
+        {
+            for (int i = 0; i < HASHES_PER_JOB; i++)
+                CSHA256().Write(data, sizeof(data)).Finalize(data);
+            return true;
+        }
+        void swap(HashJob& x) { std::swap(data, x.data); };
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 1; x < nThreads; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        std::vector<HashJob> vChecks;
+        for (size_t i = 0; i < BATCHES; i++) {
+            // Transactions with anything from one to a few dozen inputs
+            vChecks.resize(1 + (i * 7) % (BATCH_SIZE * 2));
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScaling1(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+static void CCheckQueueScaling64(benchmark::State& state) { CCheckQueueScaling(state, 64); }
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueScaling1);
+BENCHMARK(CCheckQueueScaling2);
+BENCHMARK(CCheckQueueScaling4);
+BENCHMARK(CCheckQueueScaling8);
+BENCHMARK(CCheckQueueScaling16);
+BENCHMARK(CCheckQueueScaling32);
+BENCHMARK(CCheckQueueScaling64);
@@ -10,6 +10,7 @@
 #include "uint256.h"
 #include "utiltime.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
@@ -69,6 +70,32 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+/* Number of 80 byte headers to scrypt per iteration */
+static const size_t SCRYPT_BATCH_SIZE = 64;
+
+static void Scrypt_80b(benchmark::State& state)
+{
+    std::vector<char> in(SCRYPT_BATCH_SIZE * 80, 0);
+    std::vector<char> out(SCRYPT_BATCH_SIZE * 32);
+    for (size_t i = 0; i < SCRYPT_BATCH_SIZE; i++)
+        in[i * 80] = i;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < SCRYPT_BATCH_SIZE; i++)
+            scrypt_1024_1_1_256(&in[i * 80], &out[i * 32]);
+    }
+}
+
+static void Scrypt_80b_Multi(benchmark::State& state)
+{
+    std::vector<char> in(SCRYPT_BATCH_SIZE * 80, 0);
+    std::vector<char> out(SCRYPT_BATCH_SIZE * 32);
+    for (size_t i = 0; i < SCRYPT_BATCH_SIZE; i++)
+        in[i * 80] = i;
+    scrypt_detect_multiway();
+    while (state.KeepRunning())
+        scrypt_1024_1_1_256_multi(&in[0], &out[0], SCRYPT_BATCH_SIZE);
+}
+
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
@@ -76,3 +103,6 @@ BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+
+BENCHMARK(Scrypt_80b);
+BENCHMARK(Scrypt_80b_Multi);
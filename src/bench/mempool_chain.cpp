@@ -0,0 +1,86 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+#include "validation.h"
+
+#include <vector>
+
+static std::vector<CTransactionRef> CreateChain(int nLength)
+{
+    std::vector<CTransactionRef> chain;
+    COutPoint prevout(uint256S("1234"), 0);
+    for (int i = 0; i < nLength; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        chain.push_back(MakeTransactionRef(tx));
+        prevout = COutPoint(chain.back()->GetHash(), 0);
+    }
+    return chain;
+}
+
+static CTxMemPoolEntry ChainEntry(const CTransactionRef& tx)
+{
+    LockPoints lp;
+    return CTxMemPoolEntry(tx, 1000, 0, 10.0, 1, tx->GetValueOut(), false, 4, lp);
+}
+
+// Accept a chain of unconfirmed transactions one at a time, checking the
+// ancestor and descendant limits like AcceptToMemoryPool does. Then mine the
+// first half, and disconnect that block again so the mempool has to find the
+// descendants of the returned transactions.
+static void MempoolChain(benchmark::State& state, int nLength)
+{
+    const std::vector<CTransactionRef> chain = CreateChain(nLength);
+    const std::vector<CTransactionRef> block(chain.begin(), chain.begin() + nLength / 2);
+    std::vector<uint256> vHashUpdate;
+    for (const CTransactionRef& tx : block)
+        vHashUpdate.push_back(tx->GetHash());
+
+    CTxMemPool pool(CFeeRate(1000));
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    const uint64_t nSizeLimit = nLength * 1000;
+
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : chain) {
+            CTxMemPoolEntry entry = ChainEntry(tx);
+            CTxMemPool::setEntries setAncestors;
+            std::string errString;
+            bool fAccepted = pool.CalculateMemPoolAncestors(entry, setAncestors, nLength, nSizeLimit, nLength, nSizeLimit, errString);
+            assert(fAccepted);
+            pool.addUnchecked(tx->GetHash(), entry, setAncestors);
+        }
+        pool.removeForBlock(block, 1);
+        for (const CTransactionRef& tx : block) {
+            CTxMemPoolEntry entry = ChainEntry(tx);
+            CTxMemPool::setEntries setAncestors;
+            std::string errString;
+            pool.CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, errString);
+            pool.addUnchecked(tx->GetHash(), entry, setAncestors);
+        }
+        pool.UpdateTransactionsFromBlock(vHashUpdate);
+        assert(pool.mapTx.find(chain.back()->GetHash())->GetCountWithAncestors() == (uint64_t)nLength);
+        pool.clear();
+    }
+}
+
+static void MempoolChainDefaultLimit(benchmark::State& state)
+{
+    MempoolChain(state, DEFAULT_ANCESTOR_LIMIT);
+}
+
+static void MempoolChain500(benchmark::State& state)
+{
+    MempoolChain(state, 500);
+}
+
+BENCHMARK(MempoolChainDefaultLimit);
+BENCHMARK(MempoolChain500);
@@ -4,6 +4,7 @@
 
 #include "bench.h"
 #include "policy/policy.h"
+#include "random.h"
 #include "txmempool.h"
 
 #include <list>
@@ -112,4 +113,67 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+// Fill a mempool with 500k transactions in packages of a fan-out parent and
+// chains hanging off its outputs, look up ancestors of a sample of them and
+// evict everything again.
+static const int LARGE_POOL_FANOUT = 4;
+static const int LARGE_POOL_CHAIN = 6;
+static const int LARGE_POOL_PACKAGES = 20000;
+
+static void MempoolEvictionLarge(benchmark::State& state)
+{
+    FastRandomContext rand(true);
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vFee;
+    vtx.reserve(LARGE_POOL_PACKAGES * (1 + LARGE_POOL_FANOUT * LARGE_POOL_CHAIN));
+    for (int i = 0; i < LARGE_POOL_PACKAGES; i++) {
+        CMutableTransaction root;
+        root.vin.resize(1);
+        root.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        root.vin[0].scriptSig = CScript() << OP_1;
+        root.vout.resize(LARGE_POOL_FANOUT);
+        for (CTxOut& out : root.vout) {
+            out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            out.nValue = 10 * COIN;
+        }
+        vtx.push_back(MakeTransactionRef(root));
+        vFee.push_back(1000 + rand.rand32() % 10000);
+        for (int j = 0; j < LARGE_POOL_FANOUT; j++) {
+            COutPoint prevout(root.GetHash(), j);
+            for (int k = 0; k < LARGE_POOL_CHAIN; k++) {
+                CMutableTransaction tx;
+                tx.vin.resize(1);
+                tx.vin[0].prevout = prevout;
+                tx.vin[0].scriptSig = CScript() << OP_1;
+                tx.vout.resize(1);
+                tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+                tx.vout[0].nValue = 10 * COIN;
+                vtx.push_back(MakeTransactionRef(tx));
+                vFee.push_back(1000 + rand.rand32() % 10000);
+                prevout = COutPoint(tx.GetHash(), 0);
+            }
+        }
+    }
+
+    CTxMemPool pool(CFeeRate(1000));
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    LockPoints lp;
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vtx.size(); i++) {
+            pool.addUnchecked(vtx[i]->GetHash(), CTxMemPoolEntry(vtx[i], vFee[i], 0, 10.0, 1, vtx[i]->GetValueOut(), false, 4, lp));
+        }
+        LOCK(pool.cs);
+        for (size_t i = 0; i < vtx.size(); i += 97) {
+            CTxMemPool::setEntries setAncestors;
+            std::string dummy;
+            pool.CalculateMemPoolAncestors(*pool.mapTx.find(vtx[i]->GetHash()), setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        }
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+        pool.TrimToSize(0);
+        assert(pool.size() == 0);
+    }
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolEvictionLarge);
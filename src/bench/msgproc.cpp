@@ -0,0 +1,134 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "net.h"
+#include "net_processing.h"
+#include "netmessagemaker.h"
+#include "streams.h"
+#include "util.h"
+
+#include <thread>
+#include <vector>
+
+// Simulate hundreds of connected peers that keep sending messages which
+// don't need the chain state (ping and addr), and measure how fast the
+// message handler threads work through them.
+static const int MIN_CORES = 2;
+static const int PEERS = 400;
+static const int MESSAGES_PER_PEER = 16;
+
+/** Frame a message like PushMessage does and queue it like the socket handler does */
+static void DeliverMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    std::vector<unsigned char> vch;
+    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, vch, 0, hdr};
+    vch.insert(vch.end(), msg.data.begin(), msg.data.end());
+
+    std::list<CNetMessage> msgs;
+    msgs.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    const char* pch = (const char*)vch.data();
+    unsigned int nBytes = vch.size();
+    while (nBytes > 0) {
+        int nRead = msgs.back().in_data ? msgs.back().readData(pch, nBytes) : msgs.back().readHeader(pch, nBytes);
+        assert(nRead > 0);
+        pch += nRead;
+        nBytes -= nRead;
+    }
+    assert(msgs.back().complete());
+
+    LOCK(pnode->cs_vProcessMsg);
+    pnode->nProcessQueueSize += vch.size();
+    pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), msgs);
+}
+
+static void ProcessAll(CConnman& connman, const std::vector<CNode*>& vNodes, int nThreads)
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&connman, &vNodes, i, nThreads] {
+            while (connman.ProcessNodeMessages(vNodes, vNodes.size() * i / nThreads)) {}
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+static void MessageProcessing(benchmark::State& state, int nThreads)
+{
+    CConnman connman(0x1337, 0x1337);
+    CConnman::Options options;
+    options.nSendBufferMaxSize = std::numeric_limits<unsigned int>::max();
+    options.nReceiveFloodSize = std::numeric_limits<unsigned int>::max();
+    connman.Init(options);
+    RegisterNodeSignals(GetNodeSignals());
+
+    std::vector<CNode*> vNodes;
+    for (int i = 0; i < PEERS; i++) {
+        const uint8_t ipPeer[4] = {10, 0, (uint8_t)(i >> 8), (uint8_t)i};
+        CAddress addr(CService(CNetAddr(), 0), NODE_NONE);
+        addr.SetRaw(NET_IPV4, ipPeer);
+        CNode* pnode = new CNode(i, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+        GetNodeSignals().InitializeNode(pnode, connman);
+        DeliverMessage(pnode, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERSION, PROTOCOL_VERSION, (uint64_t)NODE_NONE, GetTime(),
+            CAddress(CService(), NODE_NONE), CAddress(CService(), NODE_NONE), (uint64_t)i + 1, std::string("/bench/"), 0, false));
+        DeliverMessage(pnode, CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::VERACK));
+        vNodes.push_back(pnode);
+    }
+    ProcessAll(connman, vNodes, 1);
+    for (CNode* pnode : vNodes)
+        assert(pnode->fSuccessfullyConnected && !pnode->fDisconnect);
+
+    std::vector<CAddress> vAddr(1);
+    vAddr[0] = CAddress(CService(CNetAddr(), Params().GetDefaultPort()), NODE_NETWORK);
+    const uint8_t ipRelay[4] = {8, 8, 8, 8};
+    vAddr[0].SetRaw(NET_IPV4, ipRelay);
+
+    while (state.KeepRunning()) {
+        for (CNode* pnode : vNodes) {
+            // Drop whatever was queued for sending last round
+            LOCK(pnode->cs_vSend);
+            pnode->vSendMsg.clear();
+            pnode->nSendSize = 0;
+            pnode->nSendOffset = 0;
+            pnode->fPauseSend = false;
+        }
+        vAddr[0].nTime = GetTime();
+        for (int i = 0; i < MESSAGES_PER_PEER; i++) {
+            for (CNode* pnode : vNodes) {
+                if (i % 4 == 3)
+                    DeliverMessage(pnode, CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::ADDR, vAddr));
+                else
+                    DeliverMessage(pnode, CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::PING, (uint64_t)i));
+            }
+        }
+        ProcessAll(connman, vNodes, nThreads);
+    }
+
+    for (CNode* pnode : vNodes) {
+        bool fUpdateConnectionTime = false;
+        GetNodeSignals().FinalizeNode(pnode->GetId(), fUpdateConnectionTime);
+        delete pnode;
+    }
+    UnregisterNodeSignals(GetNodeSignals());
+}
+
+static void MessageProcessingSingleThread(benchmark::State& state)
+{
+    MessageProcessing(state, 1);
+}
+
+static void MessageProcessingThreadPool(benchmark::State& state)
+{
+    MessageProcessing(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+BENCHMARK(MessageProcessingSingleThread);
+BENCHMARK(MessageProcessingThreadPool);
@@ -0,0 +1,153 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "chain.h"
+#include "util.h"
+#include "validation.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+CBlockFileMap blockFileMap;
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(pbegin), nSize);
+#endif
+}
+
+/** Map a whole file read-only, if it is at least nMinSize bytes long */
+static std::shared_ptr<const CMappedFile> MapFile(const boost::filesystem::path& path, size_t nMinSize)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size < nMinSize) {
+        close(fd);
+        return nullptr;
+    }
+    const size_t nSize = st.st_size;
+    void* p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        LogPrintf("%s: mmap of %s failed: %s\n", __func__, path.string(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    return std::make_shared<const CMappedFile>(static_cast<const unsigned char*>(p), nSize);
+#endif
+}
+
+CBlockFileMap::CBlockFileMap(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn), nHits(0), nMaps(0)
+{
+}
+
+void CBlockFileMap::EvictLocked(size_t nTarget)
+{
+    while (listEntries.size() > nTarget) {
+        mapEntries.erase(listEntries.back().first);
+        listEntries.pop_back();
+    }
+}
+
+void CBlockFileMap::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    EvictLocked(nMaxFiles);
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMap::Get(const CDiskBlockPos& pos, const char* prefix, size_t nMinSize)
+{
+    if (pos.IsNull())
+        return nullptr;
+    const int64_t nKey = (int64_t)pos.nFile * 2 + (strcmp(prefix, "rev") == 0 ? 1 : 0);
+
+    LOCK(cs);
+    if (nMaxFiles == 0)
+        return nullptr;
+
+    std::map<int64_t, entry_list::iterator>::iterator it = mapEntries.find(nKey);
+    if (it != mapEntries.end()) {
+        if (it->second->second->size() >= nMinSize) {
+            listEntries.splice(listEntries.begin(), listEntries, it->second);
+            ++nHits;
+            return it->second->second;
+        }
+        // The file has grown since it was mapped.
+        listEntries.erase(it->second);
+        mapEntries.erase(it);
+    }
+
+    std::shared_ptr<const CMappedFile> file = MapFile(GetBlockPosFilename(pos, prefix), nMinSize);
+    if (!file)
+        return nullptr;
+    ++nMaps;
+    EvictLocked(nMaxFiles - 1);
+    listEntries.push_front(entry(nKey, file));
+    mapEntries.emplace(nKey, listEntries.begin());
+    return file;
+}
+
+void CBlockFileMap::Invalidate(int nFile)
+{
+    LOCK(cs);
+    for (int64_t nKey = (int64_t)nFile * 2; nKey <= (int64_t)nFile * 2 + 1; nKey++) {
+        std::map<int64_t, entry_list::iterator>::iterator it = mapEntries.find(nKey);
+        if (it == mapEntries.end())
+            continue;
+        listEntries.erase(it->second);
+        mapEntries.erase(it);
+    }
+}
+
+void CBlockFileMap::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapEntries.clear();
+}
+
+size_t CBlockFileMap::Size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+uint64_t CBlockFileMap::GetHits() const
+{
+    LOCK(cs);
+    return nHits;
+}
+
+uint64_t CBlockFileMap::GetMaps() const
+{
+    LOCK(cs);
+    return nMaps;
+}
+
+void InitBlockFileMap()
+{
+    // If -blockfilemaps is set to zero, every read goes through a FILE* again.
+    size_t nMaxFiles = std::min(std::max((int64_t)0, GetArg("-blockfilemaps", DEFAULT_BLOCKFILE_MAPS)), MAX_BLOCKFILE_MAPS);
+#ifdef WIN32
+    nMaxFiles = 0;
+#endif
+    blockFileMap.SetMaxFiles(nMaxFiles);
+    LogPrintf("Keeping up to %u block files memory-mapped\n", nMaxFiles);
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+
+struct CDiskBlockPos;
+
+/** Default for -blockfilemaps, the number of block and undo files kept mapped. */
+static const unsigned int DEFAULT_BLOCKFILE_MAPS = sizeof(void*) >= 8 ? 16 : 0;
+/** Maximum allowed -blockfilemaps. */
+static const int64_t MAX_BLOCKFILE_MAPS = 1024;
+
+/** A read-only memory mapping of a whole block or undo file. */
+class CMappedFile
+{
+private:
+    const unsigned char* pbegin;
+    size_t nSize;
+
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    CMappedFile(const unsigned char* pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+    ~CMappedFile();
+
+    const unsigned char* begin() const { return pbegin; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Least-recently-used set of memory-mapped blk?????.dat and rev?????.dat
+ * files, used to read blocks and undo data without a fopen/fseek/fread for
+ * every request.
+ *
+ * A mapping covers the file as it was when it was mapped. The files that are
+ * still being appended to are mapped again once a read goes past the end of
+ * the current mapping. Readers hold a reference to the mapping, so evicting
+ * or invalidating a file never unmaps memory that is still being read.
+ * Where mapping is unavailable or disabled, Get() returns nothing and the
+ * caller reads the file as usual.
+ */
+class CBlockFileMap
+{
+private:
+    typedef std::pair<int64_t, std::shared_ptr<const CMappedFile> > entry;
+    typedef std::list<entry> entry_list;
+
+    mutable CCriticalSection cs;
+    //! Mapped files in least-recently-used order, most recent at the front
+    entry_list listEntries;
+    std::map<int64_t, entry_list::iterator> mapEntries;
+    size_t nMaxFiles;
+    uint64_t nHits;
+    uint64_t nMaps;
+
+    void EvictLocked(size_t nTarget);
+
+public:
+    explicit CBlockFileMap(size_t nMaxFilesIn = DEFAULT_BLOCKFILE_MAPS);
+
+    /** Change the number of files kept mapped, unmapping files as needed. */
+    void SetMaxFiles(size_t nMaxFilesIn);
+
+    /**
+     * Get a mapping of the block or undo file containing pos.
+     * @param pos Position in the file; only the file number is used.
+     * @param prefix "blk" or "rev".
+     * @param nMinSize Number of bytes from the start of the file that the mapping has to cover.
+     * @return The mapping, or nothing if the file could not be mapped or is too short.
+     */
+    std::shared_ptr<const CMappedFile> Get(const CDiskBlockPos& pos, const char* prefix, size_t nMinSize);
+
+    /** Forget the mappings of a block file and its undo file, e.g. before it is truncated or pruned. */
+    void Invalidate(int nFile);
+    void Clear();
+
+    size_t Size() const;
+    uint64_t GetHits() const;
+    uint64_t GetMaps() const;
+};
+
+/** Global set of mapped block and undo files. */
+extern CBlockFileMap blockFileMap;
+
+/** Size the global block file map according to -blockfilemaps. */
+void InitBlockFileMap();
+
+#endif // BITCOIN_BLOCKFILEMAP_H
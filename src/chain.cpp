@@ -4,6 +4,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+
+#include "auxpowcache.h"
 #include "validation.h"
 
 using namespace std;
@@ -17,12 +19,18 @@ CBlockHeader CBlockIndex::GetBlockHeader(const Consensus::Params& consensusParam
     block.nVersion       = nVersion;
 
     /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
+       So if this is an auxpow block, take it from the auxpow cache or
+       read it from disk instead.  We only have to read the actual
+       *header*, not the full block.  */
     if (block.IsAuxpow())
     {
-        ReadBlockHeaderFromDisk(block, this, consensusParams, fCheckPOW);
-        return block;
+        bool fChecked = false;
+        if (!auxpowCache.Lookup(GetBlockHash(), block.auxpow, fChecked) || (fCheckPOW && !fChecked))
+        {
+            if (ReadBlockHeaderFromDisk(block, this, consensusParams, fCheckPOW) && block.auxpow)
+                auxpowCache.Insert(GetBlockHash(), *block.auxpow, fCheckPOW);
+            return block;
+        }
     }
 
     if (pprev)
@@ -177,3 +185,23 @@ int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& fr
     }
     return sign * r.GetLow64();
 }
+
+/** Find the last common ancestor two blocks have.
+ *  Both pa and pb must be non-NULL. */
+const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb)
+{
+    if (pa->nHeight > pb->nHeight) {
+        pa = pa->GetAncestor(pb->nHeight);
+    } else if (pb->nHeight > pa->nHeight) {
+        pb = pb->GetAncestor(pa->nHeight);
+    }
+
+    while (pa != pb && pa && pb) {
+        pa = pa->pprev;
+        pb = pb->pprev;
+    }
+
+    // Eventually all chain branches meet at the genesis block.
+    assert(pa == pb);
+    return pa;
+}
@@ -6,6 +6,9 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -16,6 +19,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Maximum number of worker threads that get a deque of their own; any more share one. */
+static const int MAX_CHECKQUEUE_DEQUES = 64;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,11 +31,29 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has a deque of its own, and each batch the master adds goes
+  * to the next worker's deque. Workers take checks from the back of their
+  * own deque, and once it runs dry, steal half of what is left at the front
+  * of another one. Workers only contend with each other when stealing; the
+  * shared mutex is only taken to sleep, to wake up and to finish.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
+    /** A deque of checks, and the number of workers using it. */
+    struct WorkerDeque {
+        boost::mutex mutex;
+        std::deque<T> checks;
+        //! Number of checks in the deque, readable without taking the mutex
+        std::atomic<unsigned int> nSize;
+        //! Number of workers using this deque (protected by the queue mutex)
+        int nWorkers;
+
+        WorkerDeque() : nSize(0), nWorkers(0) {}
+    };
+
     //! Mutex to protect the inner state
     boost::mutex mutex;
 
@@ -39,124 +63,198 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The deques of checks. The first one belongs to the master, the others to the workers.
+    std::vector<std::unique_ptr<WorkerDeque> > vDeques;
+
+    //! Number of deques that have ever been handed out, including the master's.
+    std::atomic<int> nDequesUsed;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The deque the next batch is added to.
+    int nNextDeque;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Incremented every time work is added, so workers don't miss it while going to sleep.
+    std::atomic<uint64_t> nWorkSeq;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
-
-    //! Whether we're shutting down.
-    bool fQuit;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    /**
+     * Move a batch of checks out of the deque with index nDeque into vChecks.
+     * Take from the back of our own deque, and from the front of anybody else's.
+     */
+    bool Take(int nDeque, bool fSteal, std::vector<T>& vChecks)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+        WorkerDeque& deque = *vDeques[nDeque];
+        if (deque.nSize == 0)
+            return false;
+        boost::unique_lock<boost::mutex> lock(deque.mutex);
+        // Take half of what is there, so whoever comes next finds some work too.
+        const unsigned int nNow = std::min(nBatchSize, (unsigned int)(deque.checks.size() + 1) / 2);
+        if (nNow == 0)
+            return false;
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap the jobs out instead of copying them, to keep the lock as short as possible.
+            if (fSteal) {
+                vChecks[i].swap(deque.checks.front());
+                deque.checks.pop_front();
+            } else {
+                vChecks[i].swap(deque.checks.back());
+                deque.checks.pop_back();
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+        }
+        deque.nSize = deque.checks.size();
+        return true;
     }
 
+    /** Take a batch from our own deque, or steal one from another. */
+    bool Find(int nOwnDeque, std::vector<T>& vChecks)
+    {
+        if (Take(nOwnDeque, false, vChecks))
+            return true;
+        const int nUsed = nDequesUsed;
+        for (int i = 1; i < nUsed; i++) {
+            if (Take((nOwnDeque + i) % nUsed, true, vChecks))
+                return true;
+        }
+        return false;
+    }
+
+    /** Run a batch of checks, and destroy them before they are reported as done. */
+    void Run(std::vector<T>& vChecks)
+    {
+        bool fOk = fAllOk;
+        BOOST_FOREACH (T& check, vChecks)
+            if (fOk)
+                fOk = check();
+        if (!fOk)
+            fAllOk = false;
+        const unsigned int nNow = vChecks.size();
+        vChecks.clear();
+        if (nTodo.fetch_sub(nNow) == nNow) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
+    /** Give a new worker a deque, preferring one that nobody uses. */
+    int RegisterWorker()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        int nDeque = 1;
+        for (int i = 2; i < (int)vDeques.size(); i++) {
+            if (vDeques[i]->nWorkers < vDeques[nDeque]->nWorkers)
+                nDeque = i;
+        }
+        vDeques[nDeque]->nWorkers++;
+        if (nDequesUsed <= nDeque)
+            nDequesUsed = nDeque + 1;
+        return nDeque;
+    }
+
+    /** Removes a worker again when its thread is interrupted. Whatever is left in its deque gets stolen. */
+    class WorkerGuard
+    {
+    private:
+        CCheckQueue& queue;
+        int nDeque;
+
+    public:
+        WorkerGuard(CCheckQueue& queueIn, int nDequeIn) : queue(queueIn), nDeque(nDequeIn) {}
+        ~WorkerGuard()
+        {
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            queue.vDeques[nDeque]->nWorkers--;
+        }
+    };
+
 public:
     //! Mutex to ensure only one concurrent CCheckQueueControl
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nDequesUsed(1), nNextDeque(0), nWorkSeq(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn)
+    {
+        for (int i = 0; i <= MAX_CHECKQUEUE_DEQUES; i++)
+            vDeques.emplace_back(new WorkerDeque());
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        const int nDeque = RegisterWorker();
+        WorkerGuard guard(*this, nDeque);
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            const uint64_t nSeq = nWorkSeq;
+            if (Find(nDeque, vChecks)) {
+                Run(vChecks);
+                continue;
+            }
+            // Nothing to do anywhere; sleep unless work was added since we started looking.
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nWorkSeq == nSeq)
+                condWorker.wait(lock);
+        }
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        // Only the master adds work, so once nothing can be found, the rest is being run by workers.
+        while (Find(0, vChecks))
+            Run(vChecks);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nTodo != 0)
+            condMaster.wait(lock);
+        // reset the status for new work later
+        return fAllOk.exchange(true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
+        if (vChecks.empty())
+            return;
         boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        // Hand the batch to the next worker, or keep it if there are none.
+        int nDeque = 0;
+        const int nWorkerDeques = nDequesUsed - 1;
+        for (int i = 0; i < nWorkerDeques; i++) {
+            nNextDeque = nNextDeque % nWorkerDeques + 1;
+            if (vDeques[nNextDeque]->nWorkers > 0) {
+                nDeque = nNextDeque;
+                break;
+            }
         }
         nTodo += vChecks.size();
+        {
+            WorkerDeque& deque = *vDeques[nDeque];
+            boost::unique_lock<boost::mutex> lockDeque(deque.mutex);
+            BOOST_FOREACH (T& check, vChecks) {
+                deque.checks.push_back(T());
+                check.swap(deque.checks.back());
+            }
+            deque.nSize = deque.checks.size();
+        }
+        nWorkSeq++;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -79,6 +79,12 @@ typedef u_int SOCKET;
 #define MSG_NOSIGNAL 0
 #endif
 
+// The socket handler can wait for socket events with epoll on Linux; other
+// platforms only have the select() loop.
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
 #if HAVE_DECL_STRNLEN == 0
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
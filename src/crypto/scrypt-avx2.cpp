@@ -0,0 +1,176 @@
+/*
+ * Copyright 2009 Colin Percival, 2011 ArtForz, 2012-2013 pooler
+ * Copyright 2021 The Dogecoin Core developers
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file was originally written by Colin Percival as part of the Tarsnap
+ * online backup system.
+ */
+
+/*
+ * 8-way interleaved scrypt(1024, 1, 1) using AVX2.  Each 256 bit vector holds
+ * the same 32 bit word of eight independent hashes, so the Salsa20/8 core runs
+ * on all of them at once.  The random reads of the second ROMix loop are done
+ * with gathers.
+ */
+
+#include "crypto/scrypt.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <immintrin.h>
+
+#define SCRYPT_AVX2_LANES 8
+
+#define ROTL_AVX2(a, b) _mm256_or_si256(_mm256_slli_epi32((a), (b)), _mm256_srli_epi32((a), 32 - (b)))
+
+static inline void xor_salsa8_avx2(__m256i B[16], const __m256i Bx[16])
+{
+	__m256i x00,x01,x02,x03,x04,x05,x06,x07,x08,x09,x10,x11,x12,x13,x14,x15;
+	int i;
+
+	x00 = (B[ 0] = _mm256_xor_si256(B[ 0], Bx[ 0]));
+	x01 = (B[ 1] = _mm256_xor_si256(B[ 1], Bx[ 1]));
+	x02 = (B[ 2] = _mm256_xor_si256(B[ 2], Bx[ 2]));
+	x03 = (B[ 3] = _mm256_xor_si256(B[ 3], Bx[ 3]));
+	x04 = (B[ 4] = _mm256_xor_si256(B[ 4], Bx[ 4]));
+	x05 = (B[ 5] = _mm256_xor_si256(B[ 5], Bx[ 5]));
+	x06 = (B[ 6] = _mm256_xor_si256(B[ 6], Bx[ 6]));
+	x07 = (B[ 7] = _mm256_xor_si256(B[ 7], Bx[ 7]));
+	x08 = (B[ 8] = _mm256_xor_si256(B[ 8], Bx[ 8]));
+	x09 = (B[ 9] = _mm256_xor_si256(B[ 9], Bx[ 9]));
+	x10 = (B[10] = _mm256_xor_si256(B[10], Bx[10]));
+	x11 = (B[11] = _mm256_xor_si256(B[11], Bx[11]));
+	x12 = (B[12] = _mm256_xor_si256(B[12], Bx[12]));
+	x13 = (B[13] = _mm256_xor_si256(B[13], Bx[13]));
+	x14 = (B[14] = _mm256_xor_si256(B[14], Bx[14]));
+	x15 = (B[15] = _mm256_xor_si256(B[15], Bx[15]));
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		x04 = _mm256_xor_si256(x04, ROTL_AVX2(_mm256_add_epi32(x00, x12),  7));
+		x09 = _mm256_xor_si256(x09, ROTL_AVX2(_mm256_add_epi32(x05, x01),  7));
+		x14 = _mm256_xor_si256(x14, ROTL_AVX2(_mm256_add_epi32(x10, x06),  7));
+		x03 = _mm256_xor_si256(x03, ROTL_AVX2(_mm256_add_epi32(x15, x11),  7));
+
+		x08 = _mm256_xor_si256(x08, ROTL_AVX2(_mm256_add_epi32(x04, x00),  9));
+		x13 = _mm256_xor_si256(x13, ROTL_AVX2(_mm256_add_epi32(x09, x05),  9));
+		x02 = _mm256_xor_si256(x02, ROTL_AVX2(_mm256_add_epi32(x14, x10),  9));
+		x07 = _mm256_xor_si256(x07, ROTL_AVX2(_mm256_add_epi32(x03, x15),  9));
+
+		x12 = _mm256_xor_si256(x12, ROTL_AVX2(_mm256_add_epi32(x08, x04), 13));
+		x01 = _mm256_xor_si256(x01, ROTL_AVX2(_mm256_add_epi32(x13, x09), 13));
+		x06 = _mm256_xor_si256(x06, ROTL_AVX2(_mm256_add_epi32(x02, x14), 13));
+		x11 = _mm256_xor_si256(x11, ROTL_AVX2(_mm256_add_epi32(x07, x03), 13));
+
+		x00 = _mm256_xor_si256(x00, ROTL_AVX2(_mm256_add_epi32(x12, x08), 18));
+		x05 = _mm256_xor_si256(x05, ROTL_AVX2(_mm256_add_epi32(x01, x13), 18));
+		x10 = _mm256_xor_si256(x10, ROTL_AVX2(_mm256_add_epi32(x06, x02), 18));
+		x15 = _mm256_xor_si256(x15, ROTL_AVX2(_mm256_add_epi32(x11, x07), 18));
+
+		/* Operate on rows. */
+		x01 = _mm256_xor_si256(x01, ROTL_AVX2(_mm256_add_epi32(x00, x03),  7));
+		x06 = _mm256_xor_si256(x06, ROTL_AVX2(_mm256_add_epi32(x05, x04),  7));
+		x11 = _mm256_xor_si256(x11, ROTL_AVX2(_mm256_add_epi32(x10, x09),  7));
+		x12 = _mm256_xor_si256(x12, ROTL_AVX2(_mm256_add_epi32(x15, x14),  7));
+
+		x02 = _mm256_xor_si256(x02, ROTL_AVX2(_mm256_add_epi32(x01, x00),  9));
+		x07 = _mm256_xor_si256(x07, ROTL_AVX2(_mm256_add_epi32(x06, x05),  9));
+		x08 = _mm256_xor_si256(x08, ROTL_AVX2(_mm256_add_epi32(x11, x10),  9));
+		x13 = _mm256_xor_si256(x13, ROTL_AVX2(_mm256_add_epi32(x12, x15),  9));
+
+		x03 = _mm256_xor_si256(x03, ROTL_AVX2(_mm256_add_epi32(x02, x01), 13));
+		x04 = _mm256_xor_si256(x04, ROTL_AVX2(_mm256_add_epi32(x07, x06), 13));
+		x09 = _mm256_xor_si256(x09, ROTL_AVX2(_mm256_add_epi32(x08, x11), 13));
+		x14 = _mm256_xor_si256(x14, ROTL_AVX2(_mm256_add_epi32(x13, x12), 13));
+
+		x00 = _mm256_xor_si256(x00, ROTL_AVX2(_mm256_add_epi32(x03, x02), 18));
+		x05 = _mm256_xor_si256(x05, ROTL_AVX2(_mm256_add_epi32(x04, x07), 18));
+		x10 = _mm256_xor_si256(x10, ROTL_AVX2(_mm256_add_epi32(x09, x08), 18));
+		x15 = _mm256_xor_si256(x15, ROTL_AVX2(_mm256_add_epi32(x14, x13), 18));
+	}
+	B[ 0] = _mm256_add_epi32(B[ 0], x00);
+	B[ 1] = _mm256_add_epi32(B[ 1], x01);
+	B[ 2] = _mm256_add_epi32(B[ 2], x02);
+	B[ 3] = _mm256_add_epi32(B[ 3], x03);
+	B[ 4] = _mm256_add_epi32(B[ 4], x04);
+	B[ 5] = _mm256_add_epi32(B[ 5], x05);
+	B[ 6] = _mm256_add_epi32(B[ 6], x06);
+	B[ 7] = _mm256_add_epi32(B[ 7], x07);
+	B[ 8] = _mm256_add_epi32(B[ 8], x08);
+	B[ 9] = _mm256_add_epi32(B[ 9], x09);
+	B[10] = _mm256_add_epi32(B[10], x10);
+	B[11] = _mm256_add_epi32(B[11], x11);
+	B[12] = _mm256_add_epi32(B[12], x12);
+	B[13] = _mm256_add_epi32(B[13], x13);
+	B[14] = _mm256_add_epi32(B[14], x14);
+	B[15] = _mm256_add_epi32(B[15], x15);
+}
+
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[SCRYPT_AVX2_LANES][128];
+	union {
+		__m256i i256[32];
+		uint32_t u32[32][SCRYPT_AVX2_LANES];
+	} X;
+	__m256i *V;
+	uint32_t i, k, l;
+
+	V = (__m256i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < SCRYPT_AVX2_LANES; l++) {
+		PBKDF2_SHA256((const uint8_t *)&input[l * 80], 80, (const uint8_t *)&input[l * 80], 80, 1, B[l], 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[l][4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			_mm256_store_si256(&V[i * 32 + k], X.i256[k]);
+		xor_salsa8_avx2(&X.i256[0], &X.i256[16]);
+		xor_salsa8_avx2(&X.i256[16], &X.i256[0]);
+	}
+
+	/* Each lane picks its own block of V: gather word k of block j_l for
+	   lane l from V[j_l * 32 + k], lane l. */
+	const __m256i lane_offsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i mask = _mm256_set1_epi32(1023);
+	const int *Vi = (const int *)V;
+	for (i = 0; i < 1024; i++) {
+		__m256i idx = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(X.i256[16], mask), 8), lane_offsets);
+		for (k = 0; k < 32; k++) {
+			X.i256[k] = _mm256_xor_si256(X.i256[k], _mm256_i32gather_epi32(Vi, idx, 4));
+			idx = _mm256_add_epi32(idx, _mm256_set1_epi32(SCRYPT_AVX2_LANES));
+		}
+		xor_salsa8_avx2(&X.i256[0], &X.i256[16]);
+		xor_salsa8_avx2(&X.i256[16], &X.i256[0]);
+	}
+
+	for (l = 0; l < SCRYPT_AVX2_LANES; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[l][4 * k], X.u32[k][l]);
+		PBKDF2_SHA256((const uint8_t *)&input[l * 80], 80, B[l], 128, 1, (uint8_t *)&output[l * 32], 32);
+	}
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2009 Colin Percival, 2011 ArtForz, 2012-2013 pooler
+ * Copyright 2021 The Dogecoin Core developers
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file was originally written by Colin Percival as part of the Tarsnap
+ * online backup system.
+ */
+
+/*
+ * 16-way interleaved scrypt(1024, 1, 1) using AVX-512F.  This is the same
+ * algorithm as scrypt-avx2.cpp, with each 512 bit vector holding the same 32
+ * bit word of sixteen independent hashes.
+ */
+
+#include "crypto/scrypt.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <immintrin.h>
+
+#define SCRYPT_AVX512_LANES 16
+
+#define ROTL_AVX512(a, b) _mm512_rol_epi32((a), (b))
+
+static inline void xor_salsa8_avx512(__m512i B[16], const __m512i Bx[16])
+{
+	__m512i x00,x01,x02,x03,x04,x05,x06,x07,x08,x09,x10,x11,x12,x13,x14,x15;
+	int i;
+
+	x00 = (B[ 0] = _mm512_xor_si512(B[ 0], Bx[ 0]));
+	x01 = (B[ 1] = _mm512_xor_si512(B[ 1], Bx[ 1]));
+	x02 = (B[ 2] = _mm512_xor_si512(B[ 2], Bx[ 2]));
+	x03 = (B[ 3] = _mm512_xor_si512(B[ 3], Bx[ 3]));
+	x04 = (B[ 4] = _mm512_xor_si512(B[ 4], Bx[ 4]));
+	x05 = (B[ 5] = _mm512_xor_si512(B[ 5], Bx[ 5]));
+	x06 = (B[ 6] = _mm512_xor_si512(B[ 6], Bx[ 6]));
+	x07 = (B[ 7] = _mm512_xor_si512(B[ 7], Bx[ 7]));
+	x08 = (B[ 8] = _mm512_xor_si512(B[ 8], Bx[ 8]));
+	x09 = (B[ 9] = _mm512_xor_si512(B[ 9], Bx[ 9]));
+	x10 = (B[10] = _mm512_xor_si512(B[10], Bx[10]));
+	x11 = (B[11] = _mm512_xor_si512(B[11], Bx[11]));
+	x12 = (B[12] = _mm512_xor_si512(B[12], Bx[12]));
+	x13 = (B[13] = _mm512_xor_si512(B[13], Bx[13]));
+	x14 = (B[14] = _mm512_xor_si512(B[14], Bx[14]));
+	x15 = (B[15] = _mm512_xor_si512(B[15], Bx[15]));
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		x04 = _mm512_xor_si512(x04, ROTL_AVX512(_mm512_add_epi32(x00, x12),  7));
+		x09 = _mm512_xor_si512(x09, ROTL_AVX512(_mm512_add_epi32(x05, x01),  7));
+		x14 = _mm512_xor_si512(x14, ROTL_AVX512(_mm512_add_epi32(x10, x06),  7));
+		x03 = _mm512_xor_si512(x03, ROTL_AVX512(_mm512_add_epi32(x15, x11),  7));
+
+		x08 = _mm512_xor_si512(x08, ROTL_AVX512(_mm512_add_epi32(x04, x00),  9));
+		x13 = _mm512_xor_si512(x13, ROTL_AVX512(_mm512_add_epi32(x09, x05),  9));
+		x02 = _mm512_xor_si512(x02, ROTL_AVX512(_mm512_add_epi32(x14, x10),  9));
+		x07 = _mm512_xor_si512(x07, ROTL_AVX512(_mm512_add_epi32(x03, x15),  9));
+
+		x12 = _mm512_xor_si512(x12, ROTL_AVX512(_mm512_add_epi32(x08, x04), 13));
+		x01 = _mm512_xor_si512(x01, ROTL_AVX512(_mm512_add_epi32(x13, x09), 13));
+		x06 = _mm512_xor_si512(x06, ROTL_AVX512(_mm512_add_epi32(x02, x14), 13));
+		x11 = _mm512_xor_si512(x11, ROTL_AVX512(_mm512_add_epi32(x07, x03), 13));
+
+		x00 = _mm512_xor_si512(x00, ROTL_AVX512(_mm512_add_epi32(x12, x08), 18));
+		x05 = _mm512_xor_si512(x05, ROTL_AVX512(_mm512_add_epi32(x01, x13), 18));
+		x10 = _mm512_xor_si512(x10, ROTL_AVX512(_mm512_add_epi32(x06, x02), 18));
+		x15 = _mm512_xor_si512(x15, ROTL_AVX512(_mm512_add_epi32(x11, x07), 18));
+
+		/* Operate on rows. */
+		x01 = _mm512_xor_si512(x01, ROTL_AVX512(_mm512_add_epi32(x00, x03),  7));
+		x06 = _mm512_xor_si512(x06, ROTL_AVX512(_mm512_add_epi32(x05, x04),  7));
+		x11 = _mm512_xor_si512(x11, ROTL_AVX512(_mm512_add_epi32(x10, x09),  7));
+		x12 = _mm512_xor_si512(x12, ROTL_AVX512(_mm512_add_epi32(x15, x14),  7));
+
+		x02 = _mm512_xor_si512(x02, ROTL_AVX512(_mm512_add_epi32(x01, x00),  9));
+		x07 = _mm512_xor_si512(x07, ROTL_AVX512(_mm512_add_epi32(x06, x05),  9));
+		x08 = _mm512_xor_si512(x08, ROTL_AVX512(_mm512_add_epi32(x11, x10),  9));
+		x13 = _mm512_xor_si512(x13, ROTL_AVX512(_mm512_add_epi32(x12, x15),  9));
+
+		x03 = _mm512_xor_si512(x03, ROTL_AVX512(_mm512_add_epi32(x02, x01), 13));
+		x04 = _mm512_xor_si512(x04, ROTL_AVX512(_mm512_add_epi32(x07, x06), 13));
+		x09 = _mm512_xor_si512(x09, ROTL_AVX512(_mm512_add_epi32(x08, x11), 13));
+		x14 = _mm512_xor_si512(x14, ROTL_AVX512(_mm512_add_epi32(x13, x12), 13));
+
+		x00 = _mm512_xor_si512(x00, ROTL_AVX512(_mm512_add_epi32(x03, x02), 18));
+		x05 = _mm512_xor_si512(x05, ROTL_AVX512(_mm512_add_epi32(x04, x07), 18));
+		x10 = _mm512_xor_si512(x10, ROTL_AVX512(_mm512_add_epi32(x09, x08), 18));
+		x15 = _mm512_xor_si512(x15, ROTL_AVX512(_mm512_add_epi32(x14, x13), 18));
+	}
+	B[ 0] = _mm512_add_epi32(B[ 0], x00);
+	B[ 1] = _mm512_add_epi32(B[ 1], x01);
+	B[ 2] = _mm512_add_epi32(B[ 2], x02);
+	B[ 3] = _mm512_add_epi32(B[ 3], x03);
+	B[ 4] = _mm512_add_epi32(B[ 4], x04);
+	B[ 5] = _mm512_add_epi32(B[ 5], x05);
+	B[ 6] = _mm512_add_epi32(B[ 6], x06);
+	B[ 7] = _mm512_add_epi32(B[ 7], x07);
+	B[ 8] = _mm512_add_epi32(B[ 8], x08);
+	B[ 9] = _mm512_add_epi32(B[ 9], x09);
+	B[10] = _mm512_add_epi32(B[10], x10);
+	B[11] = _mm512_add_epi32(B[11], x11);
+	B[12] = _mm512_add_epi32(B[12], x12);
+	B[13] = _mm512_add_epi32(B[13], x13);
+	B[14] = _mm512_add_epi32(B[14], x14);
+	B[15] = _mm512_add_epi32(B[15], x15);
+}
+
+void scrypt_1024_1_1_256_sp_avx512_16way(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[SCRYPT_AVX512_LANES][128];
+	union {
+		__m512i i512[32];
+		uint32_t u32[32][SCRYPT_AVX512_LANES];
+	} X;
+	__m512i *V;
+	uint32_t i, k, l;
+
+	V = (__m512i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < SCRYPT_AVX512_LANES; l++) {
+		PBKDF2_SHA256((const uint8_t *)&input[l * 80], 80, (const uint8_t *)&input[l * 80], 80, 1, B[l], 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[l][4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			_mm512_store_si512(&V[i * 32 + k], X.i512[k]);
+		xor_salsa8_avx512(&X.i512[0], &X.i512[16]);
+		xor_salsa8_avx512(&X.i512[16], &X.i512[0]);
+	}
+
+	/* Each lane picks its own block of V: gather word k of block j_l for
+	   lane l from V[j_l * 32 + k], lane l. */
+	const __m512i lane_offsets = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512i mask = _mm512_set1_epi32(1023);
+	const int *Vi = (const int *)V;
+	for (i = 0; i < 1024; i++) {
+		__m512i idx = _mm512_add_epi32(_mm512_slli_epi32(_mm512_and_si512(X.i512[16], mask), 9), lane_offsets);
+		for (k = 0; k < 32; k++) {
+			X.i512[k] = _mm512_xor_si512(X.i512[k], _mm512_i32gather_epi32(idx, Vi, 4));
+			idx = _mm512_add_epi32(idx, _mm512_set1_epi32(SCRYPT_AVX512_LANES));
+		}
+		xor_salsa8_avx512(&X.i512[0], &X.i512[16]);
+		xor_salsa8_avx512(&X.i512[16], &X.i512[0]);
+	}
+
+	for (l = 0; l < SCRYPT_AVX512_LANES; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[l][4 * k], X.u32[k][l]);
+		PBKDF2_SHA256((const uint8_t *)&input[l * 80], 80, B[l], 128, 1, (uint8_t *)&output[l * 32], 32);
+	}
+}
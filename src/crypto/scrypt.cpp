@@ -34,6 +34,19 @@
 #include <string.h>
 #include <openssl/sha.h>
 
+// The multi-lane kernels live in separately compiled libraries which are not
+// part of libdogecoinconsensus.
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+#define USE_SCRYPT_AVX2 1
+#endif
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+#define USE_SCRYPT_AVX512 1
+#endif
+
+#if defined(USE_SCRYPT_AVX2) || defined(USE_SCRYPT_AVX512)
+#include <cpuid.h>
+#endif
+
 #if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
 #ifdef _MSC_VER
 // MSVC 64bit is unable to use inline asm
@@ -257,3 +270,94 @@ void scrypt_1024_1_1_256(const char *input, char *output)
 	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
     scrypt_1024_1_1_256_sp(input, output, scratchpad);
 }
+
+typedef void (*scrypt_multiway_fn)(const char *input, char *output, char *scratchpad);
+
+// By default hash one input at a time until scrypt_detect_multiway() was called
+static scrypt_multiway_fn scrypt_multiway_kernel = NULL;
+static size_t scrypt_multiway_lanes = 1;
+static size_t scrypt_multiway_scratchpad_size = 0;
+
+#if defined(USE_SCRYPT_AVX2) || defined(USE_SCRYPT_AVX512)
+/** Return the extended control register 0, which tells which register states the OS saves. */
+static inline uint64_t scrypt_xgetbv()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return ((uint64_t)d << 32) | a;
+}
+#endif
+
+const char *scrypt_detect_multiway()
+{
+    scrypt_multiway_kernel = NULL;
+    scrypt_multiway_lanes = 1;
+    scrypt_multiway_scratchpad_size = 0;
+
+#if defined(USE_SCRYPT_AVX2) || defined(USE_SCRYPT_AVX512)
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & (1 << 27)))
+        return "scrypt-generic (no OSXSAVE)";
+    const uint64_t xcr0 = scrypt_xgetbv();
+    if (__get_cpuid_max(0, NULL) < 7)
+        return "scrypt-generic";
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+#if defined(USE_SCRYPT_AVX512)
+    // AVX512F, with the OS saving opmask, ZMM and YMM state
+    if ((ebx & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) {
+        scrypt_multiway_kernel = &scrypt_1024_1_1_256_sp_avx512_16way;
+        scrypt_multiway_lanes = 16;
+        scrypt_multiway_scratchpad_size = SCRYPT_SCRATCHPAD_SIZE_AVX512;
+        return "scrypt-avx512 (16-way)";
+    }
+#endif
+#if defined(USE_SCRYPT_AVX2)
+    // AVX2, with the OS saving YMM state
+    if ((ebx & (1 << 5)) && (xcr0 & 0x6) == 0x6) {
+        scrypt_multiway_kernel = &scrypt_1024_1_1_256_sp_avx2_8way;
+        scrypt_multiway_lanes = 8;
+        scrypt_multiway_scratchpad_size = SCRYPT_SCRATCHPAD_SIZE_AVX2;
+        return "scrypt-avx2 (8-way)";
+    }
+#endif
+#endif
+    return "scrypt-generic";
+}
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count)
+{
+    const scrypt_multiway_fn kernel = scrypt_multiway_kernel;
+    const size_t lanes = scrypt_multiway_lanes;
+    size_t i = 0;
+
+    // A partially filled group is still cheaper to hash in parallel than one
+    // input at a time, as long as at least half of the lanes are in use.
+    if (kernel != NULL && count * 2 >= lanes) {
+        char *scratchpad = (char *)malloc(scrypt_multiway_scratchpad_size);
+        if (scratchpad != NULL) {
+            for (; i + lanes <= count; i += lanes)
+                kernel(&input[i * 80], &output[i * 32], scratchpad);
+            const size_t remaining = count - i;
+            if (remaining > 1 && remaining * 2 >= lanes) {
+                char *padded_input = (char *)malloc(lanes * (80 + 32));
+                if (padded_input != NULL) {
+                    char *padded_output = padded_input + lanes * 80;
+                    memcpy(padded_input, &input[i * 80], remaining * 80);
+                    for (size_t l = remaining; l < lanes; l++)
+                        memcpy(&padded_input[l * 80], &input[i * 80], 80);
+                    kernel(padded_input, padded_output, scratchpad);
+                    memcpy(&output[i * 32], padded_output, remaining * 32);
+                    i = count;
+                    free(padded_input);
+                }
+            }
+            free(scratchpad);
+        }
+    }
+
+    if (i < count) {
+        char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+        for (; i < count; i++)
+            scrypt_1024_1_1_256_sp(&input[i * 80], &output[i * 32], scratchpad);
+    }
+}
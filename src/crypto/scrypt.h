@@ -1,5 +1,8 @@
 #ifndef SCRYPT_H
 #define SCRYPT_H
+#if defined(HAVE_CONFIG_H)
+#include "bitcoin-config.h"
+#endif
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -23,6 +26,30 @@ extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output,
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
 #endif
 
+#if defined(ENABLE_AVX2)
+static const int SCRYPT_SCRATCHPAD_SIZE_AVX2 = 8 * 131072 + 63;
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad);
+#endif
+#if defined(ENABLE_AVX512)
+static const int SCRYPT_SCRATCHPAD_SIZE_AVX512 = 16 * 131072 + 63;
+void scrypt_1024_1_1_256_sp_avx512_16way(const char *input, char *output, char *scratchpad);
+#endif
+
+/**
+ * Hash count consecutive 80 byte inputs into count consecutive 32 byte
+ * outputs, using the widest multi-lane implementation selected by
+ * scrypt_detect_multiway().  Results are identical to calling
+ * scrypt_1024_1_1_256() on every input.
+ */
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count);
+
+/**
+ * Select the multi-lane implementation used by scrypt_1024_1_1_256_multi()
+ * based on the features of the running CPU.
+ * @return A description of the selected implementation.
+ */
+const char *scrypt_detect_multiway();
+
 void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
     size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen);
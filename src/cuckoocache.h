@@ -415,6 +415,19 @@ public:
         }
     }
 
+    /** for_each calls f on every element that has been inserted and is not
+     * marked for erasure, e.g. to save the contents of the cache.
+     *
+     * @param f called with a const reference to each element
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
+
     /* contains iterates through the hash locations for a given element
      * and checks to see if it is present.
      *
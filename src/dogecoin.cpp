@@ -85,7 +85,7 @@ unsigned int CalculateDogecoinNextWorkRequired(const CBlockIndex* pindexLast, in
     return bnNew.GetCompact();
 }
 
-bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+static bool CheckAuxPowProofOfWork(const CBlockHeader& block, const uint256* phashPoW, const Consensus::Params& params)
 {
     /* Except for legacy blocks with full version 1, ensure that
        the chain ID is correct.  Legacy blocks are not allowed since
@@ -103,7 +103,7 @@ bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params&
             return error("%s : no auxpow on block with auxpow version",
                          __func__);
 
-        if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params))
+        if (!CheckProofOfWork(phashPoW ? *phashPoW : block.GetPoWHash(), block.nBits, params))
             return error("%s : non-AUX proof of work failed", __func__);
 
         return true;
@@ -116,12 +116,29 @@ bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params&
 
     if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params))
         return error("%s : AUX POW is not valid", __func__);
-    if (!CheckProofOfWork(block.auxpow->getParentBlockPoWHash(), block.nBits, params))
+    if (!CheckProofOfWork(phashPoW ? *phashPoW : block.auxpow->getParentBlockPoWHash(), block.nBits, params))
         return error("%s : AUX proof of work failed", __func__);
 
     return true;
 }
 
+bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+{
+    return CheckAuxPowProofOfWork(block, NULL, params);
+}
+
+bool CheckAuxPowProofOfWork(const CBlockHeader& block, const uint256& hashPoW, const Consensus::Params& params)
+{
+    return CheckAuxPowProofOfWork(block, &hashPoW, params);
+}
+
+const CPureBlockHeader& GetPoWHeader(const CBlockHeader& block)
+{
+    if (block.auxpow)
+        return block.auxpow->getParentBlock();
+    return block;
+}
+
 CAmount GetDogecoinBlockSubsidy(int nHeight, const Consensus::Params& consensusParams, uint256 prevHash)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -18,5 +18,22 @@ unsigned int CalculateDogecoinNextWorkRequired(const CBlockIndex* pindexLast, in
  */
 bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params);
 
+/**
+ * Check proof-of-work of a block header, taking auxpow into account, with
+ * the scrypt hash already computed (e.g. by CPureBlockHeader::GetPoWHashBatch).
+ * @param block The block header.
+ * @param hashPoW The PoW hash of the header, or of the auxpow parent block.
+ * @param params Consensus parameters.
+ * @return True iff the PoW is correct.
+ */
+bool CheckAuxPowProofOfWork(const CBlockHeader& block, const uint256& hashPoW, const Consensus::Params& params);
+
+/**
+ * Get the header whose scrypt hash has to satisfy the target of a block,
+ * i.e. the auxpow parent block for merge-mined blocks and the block itself
+ * otherwise.
+ */
+const CPureBlockHeader& GetPoWHeader(const CBlockHeader& block);
+
 CAmount GetDogecoinMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree);
 CAmount GetDogecoinDustFee(const std::vector<CTxOut> &vout, CFeeRate &baseFeeRate);
@@ -27,6 +27,7 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <boost/bind/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -182,6 +183,29 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int64_t nTime1 = GetTimeMicros();
 
+    FinishBlock(*pblocktemplate, scriptPubKeyIn, pindexPrev);
+
+    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    LogPrintf("CreateNewBlock(): total size: %u block weight: %u txs: %u fees: %ld sigops %d\n", nSerializeSize, GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+    }
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint("bench", "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+
+    // The iterators in inBlock must not outlive the mempool lock
+    inBlock.clear();
+    return std::move(pblocktemplate);
+}
+
+void BlockAssembler::FinishBlock(CBlockTemplate& blocktemplate, const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev)
+{
+    CBlock& block = blocktemplate.block;
+    const Consensus::Params& consensus = chainparams.GetConsensus(nHeight);
+
     nLastBlockTx = nBlockTx;
     nLastBlockSize = nBlockSize;
     nLastBlockWeight = nBlockWeight;
@@ -192,39 +216,58 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     coinbaseTx.vin[0].prevout.SetNull();
     coinbaseTx.vout.resize(1);
     coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetDogecoinBlockSubsidy(nHeight, consensus, pindexPrev->GetBlockHash(
-));
+    coinbaseTx.vout[0].nValue = nFees + GetDogecoinBlockSubsidy(nHeight, consensus, pindexPrev->GetBlockHash());
     coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, consensus);
-    pblocktemplate->vTxFees[0] = -nFees;
-
-    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
-    LogPrintf("CreateNewBlock(): total size: %u block weight: %u txs: %u fees: %ld sigops %d\n", nSerializeSize, GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    blocktemplate.vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, pindexPrev, consensus);
+    blocktemplate.vTxFees[0] = -nFees;
 
     // Fill in header
-    pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-    UpdateTime(pblock, consensus, pindexPrev);
-    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, consensus);
-    pblock->nNonce         = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    block.hashPrevBlock  = pindexPrev->GetBlockHash();
+    UpdateTime(&block, consensus, pindexPrev);
+    block.nBits          = GetNextWorkRequired(pindexPrev, &block, consensus);
+    block.nNonce         = 0;
+    blocktemplate.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*block.vtx[0]);
+}
 
-    CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
-        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
-    }
-    int64_t nTime2 = GetTimeMicros();
+bool BlockAssembler::AppendToBlock(CBlockTemplate& blocktemplate, CTxMemPool::txiter iter)
+{
+    if (iter->GetModifiedFee() < blockMinFeeRate.GetFee(iter->GetTxSize()))
+        return false;
+    if (!TestPackage(iter->GetTxSize(), iter->GetSigOpCost()))
+        return false;
+    CTxMemPool::setEntries package;
+    package.insert(iter);
+    if (!TestPackageTransactions(package))
+        return false;
 
-    LogPrint("bench", "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    AddToBlock(blocktemplate, iter);
+    inBlock.clear();
+    return true;
+}
 
-    return std::move(pblocktemplate);
+void BlockAssembler::RemoveFromBlock(CBlockTemplate& blocktemplate, size_t nIndex)
+{
+    assert(nIndex > 0 && nIndex < blocktemplate.block.vtx.size());
+    const CTransaction& tx = *blocktemplate.block.vtx[nIndex];
+    if (fNeedSizeAccounting) {
+        nBlockSize -= ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    }
+    nBlockWeight -= GetTransactionWeight(tx);
+    --nBlockTx;
+    nBlockSigOpsCost -= blocktemplate.vTxSigOpsCost[nIndex];
+    nFees -= blocktemplate.vTxFees[nIndex];
+
+    blocktemplate.block.vtx.erase(blocktemplate.block.vtx.begin() + nIndex);
+    blocktemplate.vTxFees.erase(blocktemplate.vTxFees.begin() + nIndex);
+    blocktemplate.vTxSigOpsCost.erase(blocktemplate.vTxSigOpsCost.begin() + nIndex);
 }
 
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
 {
-    BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
+    BOOST_FOREACH(const CTxMemPoolEntry& parent, iter->GetMemPoolParentsConst())
     {
-        if (!inBlock.count(parent)) {
+        if (!inBlock.count(mempool.mapTx.iterator_to(parent))) {
             return true;
         }
     }
@@ -330,11 +373,11 @@ bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
     return true;
 }
 
-void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
+void BlockAssembler::AddToBlock(CBlockTemplate& blocktemplate, CTxMemPool::txiter iter)
 {
-    pblock->vtx.emplace_back(iter->GetSharedTx());
-    pblocktemplate->vTxFees.push_back(iter->GetFee());
-    pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCost());
+    blocktemplate.block.vtx.emplace_back(iter->GetSharedTx());
+    blocktemplate.vTxFees.push_back(iter->GetFee());
+    blocktemplate.vTxSigOpsCost.push_back(iter->GetSigOpCost());
     if (fNeedSizeAccounting) {
         nBlockSize += ::GetSerializeSize(iter->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
     }
@@ -539,7 +582,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         SortForBlock(ancestors, iter, sortedEntries);
 
         for (size_t i=0; i<sortedEntries.size(); ++i) {
-            AddToBlock(sortedEntries[i]);
+            AddToBlock(*pblocktemplate, sortedEntries[i]);
             // Erase from the modified set, if present
             mapModifiedTx.erase(sortedEntries[i]);
         }
@@ -568,8 +611,8 @@ void BlockAssembler::addPriorityTxs()
     // This vector will be sorted into a priority queue:
     std::vector<TxCoinAgePriority> vecPriority;
     TxCoinAgePriorityCompare pricomparer;
-    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
+    std::map<CTxMemPool::txiter, double, CompareIteratorByHash> waitPriMap;
+    typedef std::map<CTxMemPool::txiter, double, CompareIteratorByHash>::iterator waitPriIter;
     double actualPriority = -1;
 
     vecPriority.reserve(mempool.mapTx.size());
@@ -609,7 +652,7 @@ void BlockAssembler::addPriorityTxs()
 
         // If this tx fits in the block add it, otherwise keep looping
         if (TestForBlock(iter)) {
-            AddToBlock(iter);
+            AddToBlock(*pblocktemplate, iter);
 
             // If now that this txs is added we've surpassed our desired priority size
             // or have dropped below the AllowFreeThreshold, then we're done adding priority txs
@@ -619,8 +662,9 @@ void BlockAssembler::addPriorityTxs()
 
             // This tx was successfully added, so
             // add transactions that depend on this one to the priority queue to try again
-            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
+            BOOST_FOREACH(const CTxMemPoolEntry& childEntry, iter->GetMemPoolChildrenConst())
             {
+                CTxMemPool::txiter child = mempool.mapTx.iterator_to(childEntry);
                 waitPriIter wpiter = waitPriMap.find(child);
                 if (wpiter != waitPriMap.end()) {
                     vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
@@ -651,3 +695,161 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+std::unique_ptr<CBlockTemplateBuilder> g_templatebuilder;
+
+/** Beyond this many mempool changes between two calls the template is rebuilt
+  * instead, so that the queue stays small on nodes nobody mines with */
+static const size_t MAX_QUEUED_MEMPOOL_CHANGES = 10000;
+
+CBlockTemplateBuilder::CBlockTemplateBuilder(const CChainParams& _chainparams)
+    : assembler(_chainparams), pindexPrev(nullptr), fMineWitnessTx(false),
+      nLastRebuild(0), fIncomplete(false), fQueueOverflow(false)
+{
+    mempool.NotifyEntryAdded.connect(boost::bind(&CBlockTemplateBuilder::TransactionAdded,
+                                                 this, boost::placeholders::_1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateBuilder::TransactionRemoved,
+                                                   this, boost::placeholders::_1,
+                                                   boost::placeholders::_2));
+}
+
+CBlockTemplateBuilder::~CBlockTemplateBuilder()
+{
+    mempool.NotifyEntryAdded.disconnect(boost::bind(&CBlockTemplateBuilder::TransactionAdded,
+                                                    this, boost::placeholders::_1));
+    mempool.NotifyEntryRemoved.disconnect(boost::bind(&CBlockTemplateBuilder::TransactionRemoved,
+                                                      this, boost::placeholders::_1,
+                                                      boost::placeholders::_2));
+}
+
+void CBlockTemplateBuilder::TransactionAdded(CTransactionRef tx)
+{
+    LOCK(cs_queue);
+    if (fQueueOverflow)
+        return;
+    if (vQueuedAdded.size() >= MAX_QUEUED_MEMPOOL_CHANGES) {
+        fQueueOverflow = true;
+        std::vector<uint256>().swap(vQueuedAdded);
+        setQueuedRemoved.clear();
+        return;
+    }
+    vQueuedAdded.push_back(tx->GetHash());
+}
+
+void CBlockTemplateBuilder::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    // Transactions leaving for a block come with a new tip, and that rebuilds
+    // the template anyway
+    if (reason == MemPoolRemovalReason::BLOCK)
+        return;
+    LOCK(cs_queue);
+    if (fQueueOverflow)
+        return;
+    if (setQueuedRemoved.size() >= MAX_QUEUED_MEMPOOL_CHANGES) {
+        fQueueOverflow = true;
+        std::vector<uint256>().swap(vQueuedAdded);
+        setQueuedRemoved.clear();
+        return;
+    }
+    setQueuedRemoved.insert(tx->GetHash());
+}
+
+bool CBlockTemplateBuilder::UpdateBlock()
+{
+    std::vector<uint256> vAdded;
+    std::set<uint256> setRemoved;
+    {
+        LOCK(cs_queue);
+        if (fQueueOverflow)
+            return false;
+        vAdded.swap(vQueuedAdded);
+        setRemoved.swap(setQueuedRemoved);
+    }
+
+    // Take out what left the mempool. Anything in the template spending it
+    // left along with it, but check so the template can't become invalid.
+    if (!setRemoved.empty()) {
+        const CBlock& block = pblocktemplate->block;
+        std::set<uint256> setTakenOut;
+        for (size_t i = 1; i < block.vtx.size(); ) {
+            const CTransaction& tx = *block.vtx[i];
+            bool fTakeOut = setRemoved.count(tx.GetHash()) > 0;
+            if (!fTakeOut) {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                    if (setTakenOut.count(txin.prevout.hash)) {
+                        fTakeOut = true;
+                        fIncomplete = true;
+                        break;
+                    }
+                }
+            }
+            if (!fTakeOut) {
+                ++i;
+                continue;
+            }
+            setTakenOut.insert(tx.GetHash());
+            setInBlock.erase(tx.GetHash());
+            assembler.RemoveFromBlock(*pblocktemplate, i);
+        }
+    }
+
+    // Append new transactions in the order they entered the mempool, which
+    // puts parents before their children
+    BOOST_FOREACH(const uint256& hash, vAdded) {
+        if (setInBlock.count(hash))
+            continue;
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end())
+            continue;
+        bool fParentsInBlock = true;
+        BOOST_FOREACH(const CTxMemPoolEntry& parent, it->GetMemPoolParentsConst()) {
+            if (!setInBlock.count(parent.GetTx().GetHash())) {
+                fParentsInBlock = false;
+                break;
+            }
+        }
+        if (fParentsInBlock && assembler.AppendToBlock(*pblocktemplate, it))
+            setInBlock.insert(hash);
+        else
+            fIncomplete = true;
+    }
+    return true;
+}
+
+std::unique_ptr<CBlockTemplate> CBlockTemplateBuilder::GetBlockTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn, int64_t nRebuildInterval)
+{
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+
+    bool fRebuild = true;
+    if (pblocktemplate && pindexPrev == chainActive.Tip() && fMineWitnessTx == fMineWitnessTxIn && UpdateBlock())
+        fRebuild = fIncomplete && GetTime() - nLastRebuild >= nRebuildInterval;
+
+    if (fRebuild) {
+        {
+            LOCK(cs_queue);
+            vQueuedAdded.clear();
+            setQueuedRemoved.clear();
+            fQueueOverflow = false;
+        }
+        // Leave no template behind if this fails
+        pblocktemplate.reset();
+        setInBlock.clear();
+
+        CScript scriptDummy = CScript() << OP_TRUE;
+        pblocktemplate = assembler.CreateNewBlock(scriptDummy, fMineWitnessTxIn);
+        if (!pblocktemplate)
+            return nullptr;
+        const CBlock& block = pblocktemplate->block;
+        for (size_t i = 1; i < block.vtx.size(); i++)
+            setInBlock.insert(block.vtx[i]->GetHash());
+        pindexPrev = chainActive.Tip();
+        fMineWitnessTx = fMineWitnessTxIn;
+        nLastRebuild = GetTime();
+        fIncomplete = false;
+    }
+
+    std::unique_ptr<CBlockTemplate> pnewtemplate(new CBlockTemplate(*pblocktemplate));
+    assembler.FinishBlock(*pnewtemplate, scriptPubKeyIn, pindexPrev);
+    return pnewtemplate;
+}
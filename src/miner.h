@@ -11,6 +11,8 @@
 
 #include <stdint.h>
 #include <memory>
+#include <set>
+#include <vector>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
@@ -78,7 +80,7 @@ struct CompareModifiedEntry {
         double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
         double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
         if (f1 == f2) {
-            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+            return CompareIteratorByHash()(a.iter, b.iter);
         }
         return f1 > f2;
     }
@@ -92,7 +94,7 @@ struct CompareTxIterByAncestorCount {
     {
         if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
             return a->GetCountWithAncestors() < b->GetCountWithAncestors();
-        return CTxMemPool::CompareIteratorByHash()(a, b);
+        return CompareIteratorByHash()(a, b);
     }
 };
 
@@ -167,12 +169,23 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
 
+    // Incremental updates of the template the last CreateNewBlock call
+    // returned (or a copy of it), for as long as the tip doesn't change.
+    // The caller must hold cs_main and mempool.cs.
+    /** Add a tx to blocktemplate if it passes the checks of assembly. Its
+      * in-mempool parents must be in blocktemplate already. */
+    bool AppendToBlock(CBlockTemplate& blocktemplate, CTxMemPool::txiter iter);
+    /** Remove the tx at nIndex from blocktemplate */
+    void RemoveFromBlock(CBlockTemplate& blocktemplate, size_t nIndex);
+    /** Create the coinbase paying scriptPubKeyIn and fill in the header */
+    void FinishBlock(CBlockTemplate& blocktemplate, const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev);
+
 private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
     /** Add a tx to the block */
-    void AddToBlock(CTxMemPool::txiter iter);
+    void AddToBlock(CBlockTemplate& blocktemplate, CTxMemPool::txiter iter);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on tx "priority" */
@@ -209,6 +222,54 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps a block template on top of the tip for the mining RPCs, which get
+ * polled much more often than the mempool can be assembled into a block.
+ *
+ * Transactions entering the mempool are appended to the template once their
+ * in-mempool parents are in it, and those leaving the mempool are taken out
+ * of it again, so serving a template is mostly a copy. The template is only
+ * assembled from scratch for a new tip, or when transactions were left out
+ * that a full assembly might pick up, at most once per rebuild interval.
+ */
+class CBlockTemplateBuilder
+{
+private:
+    CCriticalSection cs;
+    BlockAssembler assembler;
+    // The template as last assembled and updated, and the txids in it
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    std::set<uint256> setInBlock;
+    const CBlockIndex* pindexPrev;
+    bool fMineWitnessTx;
+    int64_t nLastRebuild;
+    // Whether mempool transactions were left out since the last rebuild
+    bool fIncomplete;
+
+    // Mempool changes not yet applied to the template
+    CCriticalSection cs_queue;
+    std::vector<uint256> vQueuedAdded;
+    std::set<uint256> setQueuedRemoved;
+    bool fQueueOverflow;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    /** Apply the queued mempool changes to the template, returns false if
+      * it has to be rebuilt instead */
+    bool UpdateBlock();
+
+public:
+    CBlockTemplateBuilder(const CChainParams& chainparams);
+    ~CBlockTemplateBuilder();
+
+    /** Return a template with coinbase to scriptPubKeyIn, assembling it from
+      * scratch if the tip or fMineWitnessTx changed, or if transactions were
+      * left out and the last rebuild is nRebuildInterval seconds ago */
+    std::unique_ptr<CBlockTemplate> GetBlockTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTx, int64_t nRebuildInterval);
+};
+
+extern std::unique_ptr<CBlockTemplateBuilder> g_templatebuilder;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -84,6 +84,22 @@ static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 /** Default for blocks only*/
 static const bool DEFAULT_BLOCKSONLY = false;
 
+/** How the socket handler waits for socket events (-socketevents) */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+/** -socketevents default */
+#ifdef USE_EPOLL
+static const char * const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char * const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** -msghandlerthreads default, the number of threads processing peer messages */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum allowed -msghandlerthreads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
@@ -146,9 +162,13 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
+        int nMsgHandlerThreads = 1;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
+    /** Apply the options without starting any threads, as done by Start(). */
+    void Init(const Options& connOptions);
     bool Start(CScheduler& scheduler, std::string& strNodeError, Options options);
     void Stop();
     void Interrupt();
@@ -287,6 +307,14 @@ public:
     unsigned int GetReceiveFloodSize() const;
 
     void WakeMessageHandler();
+
+    /**
+     * Process and send the pending messages of each of the given nodes once,
+     * starting at vNodesToProcess[nStart]. Nodes that another thread is
+     * handling are skipped, so the messages of a peer are always handled in
+     * order, one at a time. Returns whether any node has more work.
+     */
+    bool ProcessNodeMessages(const std::vector<CNode*>& vNodesToProcess, size_t nStart);
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -298,9 +326,16 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
+    void SocketHandlerSelect();
+#ifdef USE_EPOLL
+    void SocketHandlerEpoll();
+#endif
+    void AddSocketEvents(CNode* pnode);
+    bool SocketRecvData(CNode* pnode);
+    void InactivityCheck(CNode* pnode);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -390,8 +425,8 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** counter for waking the message processors, bumped by WakeMessageHandler(). */
+    uint64_t nMsgProcWake;
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -399,11 +434,21 @@ private:
 
     CThreadInterrupt interruptNet;
 
+    SocketEventsMode socketEventsMode;
+    //! epoll instance all sockets are registered with, if socketEventsMode is SOCKETEVENTS_EPOLL
+    int epollfd;
+    //! Nodes whose socket may still have data to read (socket handler thread only)
+    std::set<CNode*> setSocketPending;
+    //! Whether a node in setSocketPending can be read from right away (socket handler thread only)
+    bool fSocketPendingWork;
+    int64_t nLastInactivityCheck;
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
+    int nMsgHandlerThreads;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group& threadGroup);
@@ -581,6 +626,8 @@ public:
     size_t nProcessQueueSize;
 
     CCriticalSection cs_sendProcessing;
+    //! Set while a message handler thread processes this node's messages
+    std::atomic_bool fProcessingMessages;
 
     std::deque<CInv> vRecvGetData;
     uint64_t nRecvBytes;
@@ -621,6 +668,9 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Edge-triggered socket readiness, only used by the socket handler thread
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -631,6 +681,7 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    CCriticalSection cs_addrSend; // guards vAddrToSend and addrKnown
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -681,7 +732,7 @@ public:
     CAmount lastSentFeeFilter;
     int64_t nextSendTimeFeeFilter;
 
-    // Alert relay
+    // Alert relay, protected by cs_inventory
     std::vector<CAlert> vAlertToSend;
 
     CNode(NodeId id, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress &addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const std::string &addrNameIn = "", bool fInboundIn = false);
@@ -756,6 +807,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -764,6 +816,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.rand32() % vAddrToSend.size()] = _addr;
@@ -777,6 +830,7 @@ public:
     {
         // don't relay to nodes which haven't sent their version message
         if (_alert.IsInEffect() && nVersion != 0) {
+            LOCK(cs_inventory);
             vAlertToSend.push_back(_alert);
         }
     }
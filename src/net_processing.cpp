@@ -25,6 +25,7 @@
 #include "random.h"
 #include "tinyformat.h"
 #include "txmempool.h"
+#include "txrelay.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -123,6 +124,9 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /** Transaction announcements shared by all peers, protected by cs_main. */
+    std::unique_ptr<CTxRelayQueue> txRelayQueue;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -197,6 +201,8 @@ struct CNodeState {
      * otherwise: whether this peer sends non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    //! Sequence number of the next announcement to send from txRelayQueue
+    uint64_t nTxRelaySequence;
 
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
@@ -219,6 +225,7 @@ struct CNodeState {
         fHaveWitness = false;
         fWantsCmpctWitness = false;
         fSupportsDesiredCmpctVersion = false;
+        nTxRelaySequence = 0;
     }
 };
 
@@ -269,7 +276,10 @@ void InitializeNode(CNode *pnode, CConnman& connman) {
     NodeId nodeid = pnode->GetId();
     {
         LOCK(cs_main);
-        mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName)));
+        std::map<NodeId, CNodeState>::iterator it = mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName)));
+        // Only announce transactions relayed from now on
+        if (txRelayQueue)
+            it->second.nTxRelaySequence = txRelayQueue->GetEndSequence();
     }
     if(!pnode->fInbound)
         PushNodeVersion(pnode, connman, GetTime());
@@ -448,25 +458,6 @@ bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
     return false;
 }
 
-/** Find the last common ancestor two blocks have.
- *  Both pa and pb must be non-NULL. */
-const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb) {
-    if (pa->nHeight > pb->nHeight) {
-        pa = pa->GetAncestor(pb->nHeight);
-    } else if (pb->nHeight > pa->nHeight) {
-        pb = pb->GetAncestor(pa->nHeight);
-    }
-
-    while (pa != pb && pa && pb) {
-        pa = pa->pprev;
-        pb = pb->pprev;
-    }
-
-    // Eventually all chain branches meet at the genesis block.
-    assert(pa == pb);
-    return pa;
-}
-
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
@@ -742,6 +733,8 @@ void Misbehaving(NodeId pnode, int howmuch)
 PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) : connman(connmanIn) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    LOCK(cs_main);
+    txRelayQueue.reset(new CTxRelayQueue(mempool));
 }
 
 void PeerLogicValidation::SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, int nPosInBlock) {
@@ -905,12 +898,13 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                 recentRejects->reset();
             }
 
-            // Use pcoinsTip->HaveCoinsInCache as a quick approximation to exclude
+            // Use pcoinsTip->HaveCoinInCache as a quick approximation to exclude
             // requesting or processing some txs which have already been included in a block
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoinsInCache(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_BLOCK:
     case MSG_WITNESS_BLOCK:
@@ -920,13 +914,11 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
-static void RelayTransaction(const CTransaction& tx, CConnman& connman)
+void RelayTransaction(const uint256& txid)
 {
-    CInv inv(MSG_TX, tx.GetHash());
-    connman.ForEachNode([&inv](CNode* pnode)
-    {
-        pnode->PushInventory(inv);
-    });
+    LOCK(cs_main);
+    if (txRelayQueue)
+        txRelayQueue->Add(txid);
 }
 
 static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connman)
@@ -970,6 +962,10 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    // A block that is sent as stored is read after cs_main is released
+    CDiskBlockPos posRaw;
+    uint256 hashRaw, hashContinueTip;
+    {
     LOCK(cs_main);
 
     while (it != pfrom->vRecvGetData.end()) {
@@ -1033,7 +1029,19 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA) &&
+                    (inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_BLOCK && !IsWitnessEnabled(mi->second->pprev, consensusParams))))
+                {
+                    // Blocks are stored with witness data only if segwit was
+                    // active for them, so unless the peer wants it stripped
+                    // from a block that may have it, send the stored bytes as
+                    // they are. They don't need cs_main to be read.
+                    posRaw = mi->second->GetBlockPos();
+                    hashRaw = inv.hash;
+                    if (inv.hash == pfrom->hashContinue)
+                        hashContinueTip = chainActive.Tip()->GetBlockHash();
+                }
+                else if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
                     // Send block from disk
                     CBlock block;
@@ -1127,6 +1135,25 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 break;
         }
     }
+    }
+
+    if (!hashRaw.IsNull()) {
+        std::vector<unsigned char> vchBlock;
+        if (ReadRawBlockFromDisk(vchBlock, posRaw, hashRaw)) {
+            connman.PushMessage(pfrom, msgMaker.MakeRaw(NetMsgType::BLOCK, std::move(vchBlock)));
+            // Trigger the peer node to send a getblocks request for the next batch of inventory
+            if (!hashContinueTip.IsNull()) {
+                std::vector<CInv> vInv;
+                vInv.push_back(CInv(MSG_BLOCK, hashContinueTip));
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+                pfrom->hashContinue.SetNull();
+            }
+        } else {
+            // The block file may have been pruned since cs_main was released.
+            LogPrint("net", "cannot load block %s from disk, disconnect peer=%d\n", hashRaw.ToString(), pfrom->GetId());
+            pfrom->fDisconnect = true;
+        }
+    }
 
     pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
 
@@ -1788,6 +1815,16 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // Verify the scripts before taking cs_main for AcceptToMemoryPool,
+        // which then finds them in the script caches
+        bool fPreVerify;
+        {
+            LOCK(cs_main);
+            fPreVerify = !AlreadyHave(inv);
+        }
+        if (fPreVerify)
+            PreVerifyTransactions(mempool, std::vector<CTransactionRef>(1, ptx));
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
@@ -1800,7 +1837,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, &lRemovedTxn)) {
             mempool.check(pcoinsTip);
-            RelayTransaction(tx, connman);
+            RelayTransaction(tx.GetHash());
             for (unsigned int i = 0; i < tx.vout.size(); i++) {
                 vWorkQueue.emplace_back(inv.hash, i);
             }
@@ -1838,7 +1875,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                         continue;
                     if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2, &lRemovedTxn)) {
                         LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx, connman);
+                        RelayTransaction(orphanHash);
                         for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
                             vWorkQueue.emplace_back(orphanHash, i);
                         }
@@ -1928,7 +1965,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 int nDoS = 0;
                 if (!state.IsInvalid(nDoS) || nDoS == 0) {
                     LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
-                    RelayTransaction(tx, connman);
+                    RelayTransaction(tx.GetHash());
                 } else {
                     LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->id, FormatStateMessage(state));
                 }
@@ -2416,7 +2453,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman.GetAddresses();
         FastRandomContext insecure_rand;
         BOOST_FOREACH(const CAddress &addr, vAddr)
@@ -2784,8 +2824,10 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
         }
 
-        LOCK(cs_main);
-        SendRejectsAndCheckIfBanned(pfrom, connman);
+        // Don't wait for cs_main to be free; SendMessages checks again.
+        TRY_LOCK(cs_main, lockMain);
+        if (lockMain)
+            SendRejectsAndCheckIfBanned(pfrom, connman);
 
     return fMoreWork;
 }
@@ -2867,6 +2909,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
@@ -3093,7 +3136,11 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
             // Time to send but the peer has requested we not relay transactions.
             if (fSendTrickle) {
                 LOCK(pto->cs_filter);
-                if (!pto->fRelayTxes) pto->setInventoryTxToSend.clear();
+                if (!pto->fRelayTxes) {
+                    pto->setInventoryTxToSend.clear();
+                    if (txRelayQueue)
+                        state.nTxRelaySequence = txRelayQueue->GetEndSequence();
+                }
             }
 
             // Respond to BIP35 mempool requests
@@ -3131,46 +3178,24 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
                     filterrate = pto->minFeeFilter;
                 }
-                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
-                // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    uint256 hash = *it;
-                    // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
+                auto announce = [&](const uint256& hash, const CTransactionRef& ptx, const CFeeRate& feeRate) {
                     // Check if not in the filter already
                     if (pto->filterInventoryKnown.contains(hash)) {
-                        continue;
-                    }
-                    // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
-                    if (!txinfo.tx) {
-                        continue;
+                        return;
                     }
-                    if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
-                        continue;
+                    if (filterrate && feeRate.GetFeePerK() < filterrate) {
+                        return;
                     }
-                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*ptx)) return;
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
@@ -3182,7 +3207,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                             vRelayExpiration.pop_front();
                         }
 
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                        auto ret = mapRelay.insert(std::make_pair(hash, ptx));
                         if (ret.second) {
                             vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
                         }
@@ -3192,6 +3217,45 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                         vInv.clear();
                     }
                     pto->filterInventoryKnown.insert(hash);
+                };
+
+                // Transactions pushed to this peer alone, such as wallet
+                // rebroadcasts. Produce a vector with all candidates for sending
+                std::vector<std::set<uint256>::iterator> vInvTx;
+                vInvTx.reserve(pto->setInventoryTxToSend.size());
+                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
+                    vInvTx.push_back(it);
+                }
+                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
+                // A heap is used so that not all items need sorting if only a few are being sent.
+                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
+                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
+                    // Fetch the top element from the heap
+                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                    std::set<uint256>::iterator it = vInvTx.back();
+                    vInvTx.pop_back();
+                    uint256 hash = *it;
+                    // Remove it from the to-be-sent set
+                    pto->setInventoryTxToSend.erase(it);
+                    // Not in the mempool anymore? don't bother sending it.
+                    auto txinfo = mempool.info(hash);
+                    if (!txinfo.tx) {
+                        continue;
+                    }
+                    announce(hash, txinfo.tx, txinfo.feeRate);
+                }
+
+                // Transactions relayed to all peers, in the order txRelayQueue
+                // sorted them in for everyone
+                if (txRelayQueue) {
+                    txRelayQueue->Update(nNow);
+                    state.nTxRelaySequence = txRelayQueue->ForEachFrom(state.nTxRelaySequence, [&](const CTxRelayQueue::Announcement& announcement) {
+                        if (nRelayedTransactions >= INVENTORY_BROADCAST_MAX)
+                            return false;
+                        announce(announcement.tx->GetHash(), announcement.tx, announcement.feeRate);
+                        return true;
+                    });
                 }
             }
         }
@@ -3303,6 +3367,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
         //
         // Message: alert
         //
+        LOCK(pto->cs_inventory);
         BOOST_FOREACH(const CAlert &alert, pto->vAlertToSend) {
             // returns true if wasn't already contained in the set
             if (pto->setKnown.insert(alert.GetHash()).second)
@@ -43,6 +43,9 @@ struct CNodeStateStats {
     std::vector<int> vHeightInFlight;
 };
 
+/** Announce a transaction in the mempool to all peers */
+void RelayTransaction(const uint256& txid);
+
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
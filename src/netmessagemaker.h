@@ -29,6 +29,15 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /** Make a message from an already serialized payload, which is sent as is. */
+    CSerializedNetMsg MakeRaw(std::string sCommand, std::vector<unsigned char>&& data) const
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.data = std::move(data);
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
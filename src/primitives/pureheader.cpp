@@ -10,6 +10,8 @@
 #include "hash.h"
 #include "utilstrencodings.h"
 
+#include <string.h>
+
 void CPureBlockHeader::SetBaseVersion(int32_t nBaseVersion, int32_t nChainId)
 {
     assert(nBaseVersion >= 1 && nBaseVersion < VERSION_AUXPOW);
@@ -28,3 +30,15 @@ uint256 CPureBlockHeader::GetPoWHash() const
     scrypt_1024_1_1_256(BEGIN(nVersion), BEGIN(thash));
     return thash;
 }
+
+void CPureBlockHeader::GetPoWHashBatch(const std::vector<const CPureBlockHeader*>& headers, std::vector<uint256>& hashes)
+{
+    static const size_t HEADER_SIZE = 80;
+    std::vector<char> input(headers.size() * HEADER_SIZE);
+    for (size_t i = 0; i < headers.size(); i++)
+        memcpy(&input[i * HEADER_SIZE], BEGIN(headers[i]->nVersion), HEADER_SIZE);
+
+    hashes.resize(headers.size());
+    if (!headers.empty())
+        scrypt_1024_1_1_256_multi(&input[0], BEGIN(hashes[0]), headers.size());
+}
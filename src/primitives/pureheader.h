@@ -9,6 +9,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <vector>
+
 /**
  * A block header without auxpow information.  This "intermediate step"
  * in constructing the full header is useful, because it breaks the cyclic
@@ -70,6 +72,15 @@ public:
 
     uint256 GetPoWHash() const;
 
+    /**
+     * Compute the scrypt PoW hashes of several headers at once.  This uses
+     * the multi-lane scrypt implementation where the CPU supports it and is
+     * considerably faster than calling GetPoWHash() on each header.
+     * @param headers The headers to hash.
+     * @param hashes Set to the PoW hash of each header, in the same order.
+     */
+    static void GetPoWHashBatch(const std::vector<const CPureBlockHeader*>& headers, std::vector<uint256>& hashes);
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -35,6 +35,12 @@ public:
 
 typedef uint256 ChainCode;
 
+/** A public key in the parsed form used by libsecp256k1, see CPubKey::Parse(). */
+struct CParsedPubKey
+{
+    unsigned char data[64];
+};
+
 /** An encapsulated public key. */
 class CPubKey
 {
@@ -175,6 +181,15 @@ public:
      */
     bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 
+    /**
+     * Parse this public key for use with VerifyParsed(), so that verifying
+     * several signatures by it only decompresses and checks the point once.
+     */
+    bool Parse(CParsedPubKey& parsed) const;
+
+    //! Verify a DER signature against a public key returned by Parse().
+    static bool VerifyParsed(const CParsedPubKey& parsed, const uint256& hash, const std::vector<unsigned char>& vchSig);
+
     /**
      * Check whether a signature is normalized (lower-S).
      */
@@ -19,7 +19,6 @@ class RPCNestedTests : public QObject
     void rpcNestedTests();
 
 private:
-    CCoinsViewDB *pcoinsdbview;
 };
 
 #endif // BITCOIN_QT_TEST_RPC_NESTED_TESTS_H
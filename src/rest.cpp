@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "primitives/block.h"
@@ -12,6 +13,7 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
@@ -40,16 +42,19 @@ static const struct {
 };
 
 struct CCoin {
-    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside IMPLEMENT_SERIALIZE
     uint32_t nHeight;
     CTxOut out;
 
     ADD_SERIALIZE_METHODS;
 
+    CCoin() : nHeight(0) {}
+    CCoin(Coin&& in) : nHeight(in.nHeight), out(std::move(in.out)) {}
+
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
-        READWRITE(nTxVer);
+        uint32_t nTxVerDummy = 0;
+        READWRITE(nTxVerDummy);
         READWRITE(nHeight);
         READWRITE(out);
     }
@@ -61,6 +66,10 @@ extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern bool ParseAddressIndexScript(const std::string& strAddress, uint256& hashScript);
+extern UniValue AddressIndexEntryToJSON(const CAddressIndexKey& key, const CAddressIndexValue& value);
+extern UniValue AddressUnspentToJSON(const CAddressUnspentKey& key, const CAddressUnspentValue& value);
+extern UniValue SpentInfoToJSON(const CSpentIndexValue& value);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string message)
 {
@@ -213,6 +222,8 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = NULL;
+    std::vector<unsigned char> vchBlock;
+    bool fRaw = false;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -222,23 +233,28 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus(pblockindex->nHeight)))
+        // Binary and hex replies are the block as stored on disk, unless
+        // witness data has to be stripped from it.
+        if (rf != RF_JSON && RPCSerializationFlags() == 0)
+            fRaw = ReadRawBlockFromDisk(vchBlock, pblockindex);
+
+        if (!fRaw && !ReadBlockFromDisk(block, pblockindex, Params().GetConsensus(pblockindex->nHeight)))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
+    if (!fRaw && rf != RF_JSON)
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vchBlock, 0, block);
 
     switch (rf) {
     case RF_BINARY: {
-        std::string binaryBlock = ssBlock.str();
+        std::string binaryBlock(vchBlock.begin(), vchBlock.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(vchBlock.begin(), vchBlock.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -515,22 +531,11 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
             view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
 
         for (size_t i = 0; i < vOutPoints.size(); i++) {
-            CCoins coins;
-            uint256 hash = vOutPoints[i].hash;
             bool hit = false;
-            if (view.GetCoins(hash, coins)) {
-                mempool.pruneSpent(hash, coins);
-                if (coins.IsAvailable(vOutPoints[i].n)) {
-                    hit = true;
-                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
-                    // n is valid but points to an already spent output (IsNull).
-                    CCoin coin;
-                    coin.nTxVer = coins.nVersion;
-                    coin.nHeight = coins.nHeight;
-                    coin.out = coins.vout.at(vOutPoints[i].n);
-                    assert(!coin.out.IsNull());
-                    outs.push_back(coin);
-                }
+            Coin coin;
+            if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i])) {
+                hit = true;
+                outs.emplace_back(std::move(coin));
             }
 
             hits.push_back(hit);
@@ -574,7 +579,6 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         UniValue utxos(UniValue::VARR);
         BOOST_FOREACH (const CCoin& coin, outs) {
             UniValue utxo(UniValue::VOBJ);
-            utxo.push_back(Pair("txvers", (int32_t)coin.nTxVer));
             utxo.push_back(Pair("height", (int32_t)coin.nHeight));
             utxo.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
 
@@ -601,6 +605,141 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Write a page of the address index as JSON, entry by entry, rather than
+ * building the whole page as one UniValue first.
+ */
+template<typename Key, typename Value>
+static bool ReadAddressIndexPage(const Key& keyStart, long count, bool (CBlockTreeDB::*read)(const Key&, const std::function<bool(const Key&, const Value&)>&),
+                                 UniValue (*toJSON)(const Key&, const Value&), std::string& strJSON)
+{
+    long nEntries = 0;
+    std::string strNext = "null";
+    strJSON = "{\"entries\":[";
+    bool fRead = (pblocktree->*read)(keyStart, [&](const Key& key, const Value& value) {
+        if (nEntries == count) {
+            strNext = "\"" + EncodeAddressIndexCursor(key) + "\"";
+            return false;
+        }
+        if (nEntries++ > 0)
+            strJSON += ",";
+        strJSON += toJSON(key, value).write();
+        return true;
+    });
+    strJSON += "],\"next\":" + strNext + "}\n";
+    return fRead;
+}
+
+static bool rest_address(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() < 3 || path.size() > 4 || (path[0] != "history" && path[0] != "utxos"))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/address/<history|utxos>/<address>/<count>[/<cursor>].<ext>.");
+
+    if (!fAddressIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled (use -addressindex)");
+
+    uint256 hashScript;
+    if (!ParseAddressIndexScript(path[1], hashScript))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address or script hash: " + path[1]);
+
+    long count = strtol(path[2].c_str(), NULL, 10);
+    if (count < 1 || count > (long)MAX_ADDRESS_INDEX_PAGE)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Entry count out of range: " + path[2]);
+
+    switch (rf) {
+    case RF_JSON: {
+        std::string strJSON;
+        bool fRead;
+        if (path[0] == "history") {
+            CAddressIndexKey key;
+            key.hashScript = hashScript;
+            if (path.size() > 3 && !DecodeAddressIndexCursor(path[3], key))
+                return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[3]);
+            fRead = ReadAddressIndexPage(key, count, &CBlockTreeDB::ReadAddressIndex, &AddressIndexEntryToJSON, strJSON);
+        } else {
+            CAddressUnspentKey key;
+            key.hashScript = hashScript;
+            if (path.size() > 3 && !DecodeAddressIndexCursor(path[3], key))
+                return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[3]);
+            fRead = ReadAddressIndexPage(key, count, &CBlockTreeDB::ReadAddressUnspentIndex, &AddressUnspentToJSON, strJSON);
+        }
+        if (!fRead)
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read address index");
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_spent(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    const size_t nSep = param.find("-");
+    int32_t nOutput;
+    if (nSep == std::string::npos || !ParseInt32(param.substr(nSep + 1), &nOutput) || nOutput < 0 || !IsHex(param.substr(0, nSep)))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/spent/<txid>-<n>.<ext>.");
+    uint256 txid;
+    txid.SetHex(param.substr(0, nSep));
+
+    if (!fSpentIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Spent index not enabled (use -spentindex)");
+
+    CSpentIndexValue value;
+    if (!pblocktree->ReadSpentIndex(COutPoint(txid, (uint32_t)nOutput), value))
+        return RESTERR(req, HTTP_NOT_FOUND, param + " not spent");
+
+    CDataStream ssSpent(SER_NETWORK, PROTOCOL_VERSION);
+    ssSpent << value;
+
+    switch (rf) {
+    case RF_BINARY: {
+        std::string binarySpent = ssSpent.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binarySpent);
+        return true;
+    }
+
+    case RF_HEX: {
+        std::string strHex = HexStr(ssSpent.begin(), ssSpent.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        std::string strJSON = SpentInfoToJSON(value).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -613,6 +752,8 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/address/", rest_address},
+      {"/rest/spent/", rest_spent},
 };
 
 bool StartREST()
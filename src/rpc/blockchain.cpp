@@ -3,7 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "amount.h"
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -13,9 +15,12 @@
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "protocol.h"
 #include "rpc/server.h"
+#include "script/standard.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -25,6 +30,7 @@
 
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 #include <mutex>
@@ -389,10 +395,9 @@ std::string EntryDescriptionString()
            "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+void entryToJSON(UniValue &info, const CTxMemPoolSnapshot::Entry &snapshotEntry)
 {
-    AssertLockHeld(mempool.cs);
-
+    const CTxMemPoolEntry& e = snapshotEntry.entry;
     info.push_back(Pair("size", (int)e.GetTxSize()));
     info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
     info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
@@ -406,12 +411,10 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
     info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
     info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-    const CTransaction& tx = e.GetTx();
     set<string> setDepends;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    BOOST_FOREACH(const uint256& parent, snapshotEntry.vParents)
     {
-        if (mempool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(parent.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -427,15 +430,17 @@ UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
     {
-        LOCK(mempool.cs);
+        std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+        int64_t nTimeStart = GetTimeMicros();
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+        BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& e, snapshot->vEntries)
         {
-            const uint256& hash = e.GetTx().GetHash();
+            const uint256& hash = e.GetTxid();
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
             o.push_back(Pair(hash.ToString(), info));
         }
+        LogPrint("bench", "mempoolToJSON: %u transactions in %.2fms, without holding mempool.cs\n", snapshot->vEntries.size(), 0.001 * (GetTimeMicros() - nTimeStart));
         return o;
     }
     else
@@ -515,30 +520,38 @@ UniValue getmempoolancestors(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    // Copy the entries, and serialize them after releasing mempool.cs
+    std::vector<CTxMemPoolSnapshot::Entry> vAncestors;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
-    }
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+        CTxMemPool::setEntries setAncestors;
+        uint64_t noLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+
+        vAncestors.reserve(setAncestors.size());
+        BOOST_FOREACH(CTxMemPool::txiter ancestorIt, setAncestors) {
+            vAncestors.emplace_back(*ancestorIt);
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        BOOST_FOREACH(CTxMemPool::txiter ancestorIt, setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
+        BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& e, vAncestors) {
+            o.push_back(e.GetTxid().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(CTxMemPool::txiter ancestorIt, setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& e, vAncestors) {
+            const uint256& _hash = e.GetTxid();
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
             o.push_back(Pair(_hash.ToString(), info));
@@ -579,30 +592,38 @@ UniValue getmempooldescendants(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    // Copy the entries, and serialize them after releasing mempool.cs
+    std::vector<CTxMemPoolSnapshot::Entry> vDescendants;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
-    }
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(it, setDescendants);
+        // CTxMemPool::CalculateDescendants will include the given tx
+        setDescendants.erase(it);
+
+        vDescendants.reserve(setDescendants.size());
+        BOOST_FOREACH(CTxMemPool::txiter descendantIt, setDescendants) {
+            vDescendants.emplace_back(*descendantIt);
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        BOOST_FOREACH(CTxMemPool::txiter descendantIt, setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
+        BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& e, vDescendants) {
+            o.push_back(e.GetTxid().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(CTxMemPool::txiter descendantIt, setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        BOOST_FOREACH(const CTxMemPoolSnapshot::Entry& e, vDescendants) {
+            const uint256& _hash = e.GetTxid();
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
             o.push_back(Pair(_hash.ToString(), info));
@@ -631,16 +652,19 @@ UniValue getmempoolentry(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    std::unique_ptr<CTxMemPoolSnapshot::Entry> pentry;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
+        pentry.reset(new CTxMemPoolSnapshot::Entry(*it));
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(info, e);
+    entryToJSON(info, *pentry);
     return info;
 }
 
@@ -787,6 +811,12 @@ UniValue getblock(const JSONRPCRequest& request)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
+    // The hex reply is the block as stored on disk, unless witness data has
+    // to be stripped from it.
+    std::vector<unsigned char> vchBlock;
+    if (!fVerbose && RPCSerializationFlags() == 0 && ReadRawBlockFromDisk(vchBlock, pblockindex))
+        return HexStr(vchBlock.begin(), vchBlock.end());
+
     if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus(pblockindex->nHeight)))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -806,57 +836,16 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nSerializedSize;
-    uint256 hashSerialized;
-    arith_uint256 nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
-};
-
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsViewDB *view, CCoinsStats &stats)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    arith_uint256 nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    nTotalAmount += out.nValue;
-                }
-            }
-            stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    // Read from a snapshot, so that neither cs_main nor flushes of the
+    // chainstate have to wait for the scan.
+    std::unique_ptr<CCoinsViewDBSnapshot> snapshot(view->Snapshot());
+    if (!snapshot || !snapshot->GetStats(stats))
+        return false;
+    LOCK(cs_main);
+    stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     return true;
 }
 
@@ -915,7 +904,7 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         throw runtime_error(
             "gettxoutsetinfo\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time. The set is read from a snapshot by several threads.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -923,7 +912,7 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_set\": \"hash\",          (string) A hash of the set, which doesn't depend on the order of the coins\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
@@ -935,13 +924,13 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 
     CCoinsStats stats;
     FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip, stats)) {
+    if (GetUTXOStats(pcoinsdbview, stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("hash_set", stats.hashSet.GetHash().GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
@@ -949,6 +938,164 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+//! Leading bytes of a UTXO set dump
+static const unsigned char UTXO_DUMP_MAGIC[] = {'u', 't', 'x', 'o', 0xff};
+static const uint16_t UTXO_DUMP_VERSION = 1;
+
+//! Write the outputs of txid in a UTXO set dump
+static void WriteUTXODumpTx(CAutoFile &file, const uint256 &txid, const std::vector<std::pair<uint32_t, Coin> > &outputs)
+{
+    file << txid;
+    file << VARINT((uint64_t)outputs.size());
+    for (const auto& output : outputs) {
+        file << VARINT(output.first);
+        file << output.second;
+    }
+}
+
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set to a file, read from a snapshot.\n"
+            "\nThe file starts with the bytes 'utxo' 0xff, a 2-byte version (1), the network magic,\n"
+            "the best block hash, its height as 4 bytes and the 8-byte number of coins. For every\n"
+            "transaction with unspent outputs, in txid order, it then holds the txid, the number of\n"
+            "outputs and, for each output, its index and the coin as the chainstate database stores it.\n"
+            "Numbers are little-endian; counts and indexes are VARINTs.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, which must not exist yet\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,      (numeric) The number of coins written\n"
+            "  \"base_hash\": \"hash\",    (string) The hash of the block the set is at\n"
+            "  \"base_height\": n,        (numeric) The height of that block\n"
+            "  \"hash_set\": \"hash\",     (string) The hash of the set, as gettxoutsetinfo returns it\n"
+            "  \"path\": \"path\"          (string) The absolute path of the file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    const boost::filesystem::path path = boost::filesystem::absolute(request.params[0].get_str(), GetDataDir());
+    // Write to a temporary file, so that an interrupted dump isn't mistaken for a complete one
+    const boost::filesystem::path pathTemp = path.string() + ".incomplete";
+    if (boost::filesystem::exists(path) || boost::filesystem::exists(pathTemp))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    FlushStateToDisk();
+    std::unique_ptr<CCoinsViewDBSnapshot> snapshot(pcoinsdbview->Snapshot());
+    if (!snapshot)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+    const uint256 hashBlock = snapshot->GetBestBlock();
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = mapBlockIndex.find(hashBlock)->second->nHeight;
+    }
+
+    CAutoFile file(fopen(pathTemp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open " + pathTemp.string());
+    file.write((const char*)UTXO_DUMP_MAGIC, sizeof(UTXO_DUMP_MAGIC));
+    file << UTXO_DUMP_VERSION;
+    file.write((const char*)Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    file << hashBlock;
+    file << nHeight;
+    // The number of coins is filled in once they are written
+    const long nCoinsPos = ftell(file.Get());
+    uint64_t nCoins = 0;
+    file << nCoins;
+
+    CCoinsSetHash hashSet;
+    std::unique_ptr<CCoinsViewCursor> pcursor(snapshot->Cursor());
+    uint256 prevkey;
+    std::vector<std::pair<uint32_t, Coin> > outputs;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        if (!outputs.empty() && key.hash != prevkey) {
+            WriteUTXODumpTx(file, prevkey, outputs);
+            outputs.clear();
+        }
+        prevkey = key.hash;
+        hashSet.Add(key, coin);
+        outputs.emplace_back(key.n, std::move(coin));
+        nCoins++;
+        pcursor->Next();
+    }
+    if (!outputs.empty())
+        WriteUTXODumpTx(file, prevkey, outputs);
+
+    if (fseek(file.Get(), nCoinsPos, SEEK_SET) != 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to write " + pathTemp.string());
+    file << nCoins;
+    if (fflush(file.Get()) != 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to write " + pathTemp.string());
+    FileCommit(file.Get());
+    file.fclose();
+    if (!RenameOver(pathTemp, path))
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to rename " + pathTemp.string());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", nCoins));
+    ret.push_back(Pair("base_hash", hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", nHeight));
+    ret.push_back(Pair("hash_set", hashSet.GetHash().GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+UniValue getchainstateflushinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getchainstateflushinfo\n"
+            "\nReturns statistics about writing the UTXO cache to the chainstate database.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"background\": true|false,    (boolean) Whether flushes are written by the background flush thread\n"
+            "  \"in_progress\": true|false,   (boolean) Whether a flush is currently being written\n"
+            "  \"flushes\": n,                (numeric) The number of completed flushes since startup\n"
+            "  \"bestblock\": \"hex\",          (string) The block hash committed by the last completed flush\n"
+            "  \"last_stall_ms\": x.xxx,      (numeric) Milliseconds the last flush blocked block validation\n"
+            "  \"last_write_ms\": x.xxx,      (numeric) Milliseconds spent writing the last completed flush\n"
+            "  \"last_batches\": n,           (numeric) The number of database batches of the last completed flush\n"
+            "  \"last_coins\": n,             (numeric) The number of changed outputs written by the last completed flush\n"
+            "  \"last_bytes\": n,             (numeric) The number of bytes written by the last completed flush\n"
+            "  \"total_bytes\": n,            (numeric) The number of bytes written by all completed flushes\n"
+            "  \"total_write_ms\": x.xxx      (numeric) Milliseconds spent writing all completed flushes\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getchainstateflushinfo", "")
+            + HelpExampleRpc("getchainstateflushinfo", "")
+        );
+
+    LOCK(cs_main);
+    if (!pcoinsdbview)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Chainstate database not loaded");
+    CCoinsFlushStats stats = pcoinsdbview->GetFlushStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("background", stats.fBackground));
+    ret.push_back(Pair("in_progress", stats.fInProgress));
+    ret.push_back(Pair("flushes", (uint64_t)stats.nFlushes));
+    ret.push_back(Pair("bestblock", stats.hashLastBlock.GetHex()));
+    ret.push_back(Pair("last_stall_ms", stats.nLastStallMicros * 0.001));
+    ret.push_back(Pair("last_write_ms", stats.nLastWriteMicros * 0.001));
+    ret.push_back(Pair("last_batches", (uint64_t)stats.nLastBatches));
+    ret.push_back(Pair("last_coins", (uint64_t)stats.nLastCoins));
+    ret.push_back(Pair("last_bytes", (uint64_t)stats.nLastBytes));
+    ret.push_back(Pair("total_bytes", (uint64_t)stats.nTotalBytes));
+    ret.push_back(Pair("total_write_ms", stats.nTotalWriteMicros * 0.001));
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -974,7 +1121,6 @@ UniValue gettxout(const JSONRPCRequest& request)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "}\n"
 
@@ -998,34 +1144,321 @@ UniValue gettxout(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
-    CCoins coins;
+    COutPoint out(hash, n);
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) { // TODO: filtering spent coins should be done by the CCoinsViewMemPool
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        }
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin)) {
             return NullUniValue;
+        }
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT) {
         ret.push_back(Pair("confirmations", 0));
-    else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+    } else {
+        ret.push_back(Pair("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1)));
+    }
+    ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
+    ret.push_back(Pair("coinbase", (bool)coin.fCoinBase));
+
+    return ret;
+}
 
+bool ParseAddressIndexScript(const std::string& strAddress, uint256& hashScript)
+{
+    CBitcoinAddress address(strAddress);
+    if (address.IsValid()) {
+        hashScript = GetScriptHash(GetScriptForDestination(address.Get()));
+        return true;
+    }
+    if (IsHex(strAddress) && strAddress.size() == 64) {
+        hashScript.SetHex(strAddress);
+        return true;
+    }
+    return false;
+}
+
+UniValue AddressIndexEntryToJSON(const CAddressIndexKey& key, const CAddressIndexValue& value)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.push_back(Pair("txid", value.txid.GetHex()));
+    entry.push_back(Pair("height", key.nHeight));
+    entry.push_back(Pair(key.fSpending ? "vin" : "vout", (int64_t)key.nIndex));
+    entry.push_back(Pair("spending", key.fSpending));
+    entry.push_back(Pair("value", ValueFromAmount(key.fSpending ? -value.nValue : value.nValue)));
+    return entry;
+}
+
+UniValue AddressUnspentToJSON(const CAddressUnspentKey& key, const CAddressUnspentValue& value)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.push_back(Pair("txid", key.txid.GetHex()));
+    entry.push_back(Pair("vout", (int64_t)key.n));
+    entry.push_back(Pair("height", key.nHeight));
+    entry.push_back(Pair("value", ValueFromAmount(value.nValue)));
+    entry.push_back(Pair("coinbase", value.fCoinBase));
+    return entry;
+}
+
+/** Parse the address, count and cursor arguments shared by the address index calls into key */
+template<typename Key>
+static unsigned int ParseAddressIndexPage(const JSONRPCRequest& request, Key& key)
+{
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled (use -addressindex)");
+    if (!ParseAddressIndexScript(request.params[0].get_str(), key.hashScript))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script hash");
+    int nCount = DEFAULT_ADDRESS_INDEX_PAGE;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        nCount = request.params[1].get_int();
+    if (nCount < 1 || nCount > (int)MAX_ADDRESS_INDEX_PAGE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 1 and %u", MAX_ADDRESS_INDEX_PAGE));
+    if (request.params.size() > 2 && !request.params[2].isNull() && !DecodeAddressIndexCursor(request.params[2].get_str(), key))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    return nCount;
+}
+
+UniValue getaddresshistory(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw runtime_error(
+            "getaddresshistory \"address\" ( count \"cursor\" )\n"
+            "\nReturns the outputs paid to and the inputs spending from an address, in chain order.\n"
+            "Requires -addressindex. Pass the returned cursor to get the next page.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The dogecoin address, or the hex SHA256 of a scriptPubKey\n"
+            "2. count          (numeric, optional, default=" + std::to_string(DEFAULT_ADDRESS_INDEX_PAGE) + ") The number of entries to return, at most " + std::to_string(MAX_ADDRESS_INDEX_PAGE) + "\n"
+            "3. \"cursor\"     (string, optional) Where to continue, as returned by a previous call\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": [\n"
+            "    {\n"
+            "      \"txid\": \"hex\",         (string) The transaction paying to or spending from the address\n"
+            "      \"height\": n,           (numeric) The height of the block containing it\n"
+            "      \"vout\"|\"vin\": n,       (numeric) The index of the output or input\n"
+            "      \"spending\": true|false, (boolean) Whether this is an input spending from the address\n"
+            "      \"value\": x.xxx         (numeric) The value in " + CURRENCY_UNIT + ", negative for inputs\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"next\": \"cursor\"        (string) Where the next page starts, or null at the end\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresshistory", "\"DTaXouBvXCDfViRZzSCaVNQBAyt1D9zThT\" 100")
+            + HelpExampleRpc("getaddresshistory", "\"DTaXouBvXCDfViRZzSCaVNQBAyt1D9zThT\", 100")
+        );
+
+    CAddressIndexKey key;
+    const unsigned int nCount = ParseAddressIndexPage(request, key);
+
+    UniValue entries(UniValue::VARR);
+    UniValue next(UniValue::VNULL);
+    bool fRead = pblocktree->ReadAddressIndex(key, [&](const CAddressIndexKey& keyEntry, const CAddressIndexValue& value) {
+        if (entries.size() == nCount) {
+            next = EncodeAddressIndexCursor(keyEntry);
+            return false;
+        }
+        entries.push_back(AddressIndexEntryToJSON(keyEntry, value));
+        return true;
+    });
+    if (!fRead)
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read address index");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", entries));
+    ret.push_back(Pair("next", next));
+    return ret;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw runtime_error(
+            "getaddressutxos \"address\" ( count \"cursor\" )\n"
+            "\nReturns the unspent outputs paid to an address, in chain order.\n"
+            "Requires -addressindex. Pass the returned cursor to get the next page.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The dogecoin address, or the hex SHA256 of a scriptPubKey\n"
+            "2. count          (numeric, optional, default=" + std::to_string(DEFAULT_ADDRESS_INDEX_PAGE) + ") The number of outputs to return, at most " + std::to_string(MAX_ADDRESS_INDEX_PAGE) + "\n"
+            "3. \"cursor\"     (string, optional) Where to continue, as returned by a previous call\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": [\n"
+            "    {\n"
+            "      \"txid\": \"hex\",         (string) The transaction id\n"
+            "      \"vout\": n,             (numeric) The output index\n"
+            "      \"height\": n,           (numeric) The height of the block containing it\n"
+            "      \"value\": x.xxx,        (numeric) The value in " + CURRENCY_UNIT + "\n"
+            "      \"coinbase\": true|false (boolean) Coinbase or not\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"next\": \"cursor\"        (string) Where the next page starts, or null at the end\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"DTaXouBvXCDfViRZzSCaVNQBAyt1D9zThT\"")
+            + HelpExampleRpc("getaddressutxos", "\"DTaXouBvXCDfViRZzSCaVNQBAyt1D9zThT\"")
+        );
+
+    CAddressUnspentKey key;
+    const unsigned int nCount = ParseAddressIndexPage(request, key);
+
+    UniValue entries(UniValue::VARR);
+    UniValue next(UniValue::VNULL);
+    bool fRead = pblocktree->ReadAddressUnspentIndex(key, [&](const CAddressUnspentKey& keyEntry, const CAddressUnspentValue& value) {
+        if (entries.size() == nCount) {
+            next = EncodeAddressIndexCursor(keyEntry);
+            return false;
+        }
+        entries.push_back(AddressUnspentToJSON(keyEntry, value));
+        return true;
+    });
+    if (!fRead)
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read address index");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", entries));
+    ret.push_back(Pair("next", next));
+    return ret;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"\n"
+            "\nReturns the total of the unspent outputs paid to an address. Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The dogecoin address, or the hex SHA256 of a scriptPubKey\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,  (numeric) The total value in " + CURRENCY_UNIT + "\n"
+            "  \"utxos\": n         (numeric) The number of unspent outputs\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"DTaXouBvXCDfViRZzSCaVNQBAyt1D9zThT\"")
+            + HelpExampleRpc("getaddressbalance", "\"DTaXouBvXCDfViRZzSCaVNQBAyt1D9zThT\"")
+        );
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled (use -addressindex)");
+    CAddressUnspentKey key;
+    if (!ParseAddressIndexScript(request.params[0].get_str(), key.hashScript))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script hash");
+
+    CAmount nBalance = 0;
+    uint64_t nOutputs = 0;
+    bool fRead = pblocktree->ReadAddressUnspentIndex(key, [&](const CAddressUnspentKey& keyEntry, const CAddressUnspentValue& value) {
+        nBalance += value.nValue;
+        nOutputs++;
+        return true;
+    });
+    if (!fRead)
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read address index");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    ret.push_back(Pair("utxos", nOutputs));
+    return ret;
+}
+
+UniValue SpentInfoToJSON(const CSpentIndexValue& value)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.push_back(Pair("txid", value.txid.GetHex()));
+    entry.push_back(Pair("vin", (int64_t)value.nInputIndex));
+    entry.push_back(Pair("height", value.nHeight));
+    LOCK(cs_main);
+    if (chainActive[value.nHeight])
+        entry.push_back(Pair("blockhash", chainActive[value.nHeight]->GetBlockHash().GetHex()));
+    return entry;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the input of the active chain spending a transaction output. Requires -spentindex.\n"
+            "\nArguments:\n"
+            "1. \"txid\"       (string, required) The transaction id\n"
+            "2. n            (numeric, required) The output number\n"
+            "\nResult (null if the output is unspent or unknown):\n"
+            "{\n"
+            "  \"txid\": \"hash\",      (string) The spending transaction id\n"
+            "  \"vin\": n,            (numeric) The index of the spending input\n"
+            "  \"height\": n,         (numeric) The height of the block including the spending transaction\n"
+            "  \"blockhash\": \"hash\"  (string) The hash of that block\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "\"txid\" 1")
+            + HelpExampleRpc("getspentinfo", "\"txid\", 1")
+        );
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled (use -spentindex)");
+    const uint256 txid = ParseHashV(request.params[0], "txid");
+    const int n = request.params[1].get_int();
+    if (n < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output number");
+    const COutPoint outpoint(txid, n);
+
+    CSpentIndexValue value;
+    if (!pblocktree->ReadSpentIndex(outpoint, value))
+        return NullUniValue;
+    return SpentInfoToJSON(value);
+}
+
+UniValue getutxocommitment(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw runtime_error(
+            "getutxocommitment ( \"blockhash\" )\n"
+            "\nReturns the hash of the UTXO set as of a block. Requires -utxocommitment.\n"
+            "It is kept for every block connected since the option was enabled, and equals hash_set of gettxoutsetinfo.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"  (string, optional, default=the tip) The block hash\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockhash\": \"hash\", (string) The block hash\n"
+            "  \"height\": n,          (numeric) The block height\n"
+            "  \"hash\": \"hash\"       (string) The hash of the UTXO set\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getutxocommitment", "")
+            + HelpExampleRpc("getutxocommitment", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+        );
+
+    if (!fUTXOCommitment)
+        throw JSONRPCError(RPC_MISC_ERROR, "UTXO set commitment not enabled (use -utxocommitment)");
+
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Tip();
+    if (request.params.size() > 0) {
+        const uint256 hash = ParseHashV(request.params[0], "blockhash");
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pindex = it->second;
+    }
+
+    CCoinsSetHash hashSet;
+    if (!pblocktree->ReadUTXOCommitment(pindex->GetBlockHash(), hashSet))
+        throw JSONRPCError(RPC_MISC_ERROR, "No UTXO set commitment for this block");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blockhash", pindex->GetBlockHash().GetHex()));
+    ret.push_back(Pair("height", pindex->nHeight));
+    ret.push_back(Pair("hash", hashSet.GetHash().GetHex()));
     return ret;
 }
 
@@ -1139,6 +1572,7 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,  (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
             "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"utxo_commitment\": \"...\", (string) the hash of the UTXO set as of the best block (only present if -utxocommitment is enabled)\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1193,6 +1627,9 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             obj.push_back(Pair("prune_target_size",  nPruneTarget));
         }
     }
+    CCoinsSetHash hashSet;
+    if (fUTXOCommitment && pblocktree->ReadUTXOCommitment(chainActive.Tip()->GetBlockHash(), hashSet))
+        obj.push_back(Pair("utxo_commitment",    hashSet.GetHash().GetHex()));
 
     const Consensus::Params& consensusParams = Params().GetConsensus(0);
     CBlockIndex* tip = chainActive.Tip();
@@ -1478,12 +1915,17 @@ UniValue reconsiderblock(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ ----------
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      true,  {"address"} },
+    { "blockchain",         "getaddresshistory",      &getaddresshistory,      true,  {"address","count","cursor"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        true,  {"address","count","cursor"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
     { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
+    { "blockchain",         "getchainstateflushinfo", &getchainstateflushinfo, true,  {} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
@@ -1491,8 +1933,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           true,  {"txid","n"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "getutxocommitment",      &getutxocommitment,      true,  {"blockhash"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
 
@@ -92,6 +92,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "signrawtransaction", 2, "privkeys" },
     { "sendrawtransaction", 1, "allowhighfees" },
     { "fundrawtransaction", 1, "options" },
+    { "getaddresshistory", 1, "count" },
+    { "getaddressutxos", 1, "count" },
+    { "getspentinfo", 1, "n" },
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
     { "gettxoutproof", 0, "txids" },
@@ -535,13 +535,12 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
     // Update block
     static CBlockIndex* pindexPrev;
-    static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
+        mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -550,12 +549,14 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         // Store the pindexBest used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
         fLastTemplateSupportsSegwit = fSupportsSegwit;
 
-        // Create new block
+        // Update the block; it is only assembled from scratch every 5 seconds
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fMineWitnessTx);
+        if (g_templatebuilder)
+            pblocktemplate = g_templatebuilder->GetBlockTemplate(scriptDummy, fMineWitnessTx, 5);
+        else
+            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fMineWitnessTx);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -1032,7 +1033,11 @@ UniValue getauxblockbip22(const JSONRPCRequest& request)
             }
 
             // Create new block with nonce = 0 and extraNonce = 1
-            std::unique_ptr<CBlockTemplate> newBlock(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, fMineWitnessTx));
+            std::unique_ptr<CBlockTemplate> newBlock;
+            if (g_templatebuilder)
+                newBlock = g_templatebuilder->GetBlockTemplate(coinbaseScript->reserveScript, fMineWitnessTx, 60);
+            else
+                newBlock = BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, fMineWitnessTx);
             if (!newBlock)
                 throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
 
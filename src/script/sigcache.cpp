@@ -16,27 +16,6 @@
 
 namespace {
 
-/**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
- *
- * This may exhibit platform endian dependent behavior but because these are
- * nonced hashes (random) and this state is only ever used locally it is safe.
- * All that matters is local consistency.
- */
-class SignatureCacheHasher
-{
-public:
-    template <uint8_t hash_select>
-    uint32_t operator()(const uint256& key) const
-    {
-        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
-        uint32_t u;
-        std::memcpy(&u, key.begin()+4*hash_select, 4);
-        return u;
-    }
-};
-
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
@@ -79,6 +58,21 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    void GetEntries(uint256& nonceOut, std::vector<uint256>& vEntries)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonceOut = nonce;
+        setValid.for_each([&vEntries](const uint256& entry) { vEntries.push_back(entry); });
+    }
+
+    void SetEntries(const uint256& nonceIn, const std::vector<uint256>& vEntries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (const uint256& entry : vEntries)
+            setValid.insert(entry);
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -95,21 +89,62 @@ void InitSignatureCache()
 {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
-    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    // The other half of -maxsigcachesize goes to the script execution cache.
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
     size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
     LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
 }
 
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& vEntries)
+{
+    signatureCache.GetEntries(nonce, vEntries);
+}
+
+void SetSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& vEntries)
+{
+    signatureCache.SetEntries(nonce, vEntries);
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
     if (signatureCache.Get(entry, !store))
         return true;
-    if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
+    if (pubkeycache) {
+        if (!pubkeycache->Verify(pubkey, sighash, vchSig))
+            return false;
+    } else if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
     if (store)
         signatureCache.Set(entry);
     return true;
 }
+
+bool CPubKeyParseCache::Verify(const CPubKey& pubkey, const uint256& sighash, const std::vector<unsigned char>& vchSig)
+{
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs);
+        std::map<CPubKey, CParsedPubKey>::const_iterator it = mapParsed.find(pubkey);
+        if (it != mapParsed.end()) {
+            ++nHits;
+            return CPubKey::VerifyParsed(it->second, sighash, vchSig);
+        }
+    }
+
+    CParsedPubKey parsed;
+    if (!pubkey.Parse(parsed))
+        return false;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs);
+        mapParsed.emplace(pubkey, parsed);
+    }
+    return CPubKey::VerifyParsed(parsed, sighash, vchSig);
+}
+
+size_t CPubKeyParseCache::Size()
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs);
+    return mapParsed.size();
+}
@@ -6,10 +6,16 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "pubkey.h"
 #include "script/interpreter.h"
 
+#include <atomic>
+#include <cstring>
+#include <map>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
 // systems). Due to how we count cache size, actual memory usage is slightly
 // more (~32.25 MB)
@@ -17,19 +23,71 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
-class CPubKey;
+/**
+ * We're hashing a nonce into the entries themselves, so we don't need extra
+ * blinding in the set hash computation.
+ *
+ * This may exhibit platform endian dependent behavior but because these are
+ * nonced hashes (random) and this state is only ever used locally it is safe.
+ * All that matters is local consistency.
+ */
+class SignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin()+4*hash_select, 4);
+        return u;
+    }
+};
+
+/**
+ * Public keys parsed while verifying the scripts of one block. The same keys
+ * are often used many times in a block (exchange and pool hot wallets), so
+ * the script check workers share the parsed keys instead of decompressing
+ * and checking the same point for every signature. Its size is bounded by
+ * the number of signature checks in the block.
+ */
+class CPubKeyParseCache
+{
+private:
+    boost::shared_mutex cs;
+    std::map<CPubKey, CParsedPubKey> mapParsed;
+    std::atomic<uint64_t> nHits;
+
+public:
+    CPubKeyParseCache() : nHits(0) {}
+
+    //! Same as pubkey.Verify(sighash, vchSig), parsing pubkey only the first time it is seen.
+    bool Verify(const CPubKey& pubkey, const uint256& sighash, const std::vector<unsigned char>& vchSig);
+
+    size_t Size();
+    uint64_t GetHits() const { return nHits; }
+};
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    CPubKeyParseCache* pubkeycache;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amount, txdataIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn, PrecomputedTransactionData& txdataIn, CPubKeyParseCache* pubkeycacheIn = NULL) : TransactionSignatureChecker(txToIn, nInIn, amount, txdataIn), store(storeIn), pubkeycache(pubkeycacheIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
 void InitSignatureCache();
 
+/** Copy the salt and the entries of the signature cache, e.g. to save them to disk. */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& vEntries);
+/**
+ * Replace the salt of the signature cache and add entries computed with it,
+ * e.g. ones saved by an earlier run. Entries added before are no longer found.
+ */
+void SetSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& vEntries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
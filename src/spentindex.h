@@ -0,0 +1,44 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+/** Default for -spentindex */
+static const bool DEFAULT_SPENTINDEX = false;
+
+/**
+ * The input of the active chain spending an output. The spent index files
+ * these under the outpoint they spend.
+ */
+struct CSpentIndexValue
+{
+    //! The spending transaction
+    uint256 txid;
+    //! Index of the input in the spending transaction
+    unsigned int nInputIndex;
+    //! Height of the block including the spending transaction
+    int nHeight;
+
+    CSpentIndexValue() : nInputIndex(0), nHeight(-1) {}
+    CSpentIndexValue(const uint256& txidIn, unsigned int nInputIndexIn, int nHeightIn) :
+        txid(txidIn), nInputIndex(nInputIndexIn), nHeight(nHeightIn) {}
+
+    //! A null value stands for an entry to erase
+    bool IsNull() const { return nHeight == -1; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(VARINT(nInputIndex));
+        READWRITE(VARINT(nHeight));
+    }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
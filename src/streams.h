@@ -138,6 +138,65 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from an existing byte buffer without copying it.
+ *  The buffer must outlive the reader.
+ */
+class CBufferReader
+{
+ public:
+
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  pbeginIn Start of the referenced buffer
+ * @param[in]  nSizeIn Size of the referenced buffer
+*/
+    CBufferReader(int nTypeIn, int nVersionIn, const unsigned char* pbeginIn, size_t nSizeIn) : nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), nSize(nSizeIn), nPos(0) {}
+
+    void read(char* pch, size_t nRead)
+    {
+        if (nRead > nSize - nPos)
+            throw std::ios_base::failure("CBufferReader::read(): end of data");
+        memcpy(pch, pbegin + nPos, nRead);
+        nPos += nRead;
+    }
+    void ignore(size_t nSkip)
+    {
+        if (nSkip > nSize - nPos)
+            throw std::ios_base::failure("CBufferReader::ignore(): end of data");
+        nPos += nSkip;
+    }
+    template<typename T>
+    CBufferReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    size_t size() const
+    {
+        return nSize - nPos;
+    }
+    bool empty() const
+    {
+        return nPos == nSize;
+    }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pbegin;
+    const size_t nSize;
+    size_t nPos;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -0,0 +1,193 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include "memusage.h"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory resource for node based containers (std::set, std::map,
+ * boost::multi_index_container), which allocate their elements one at a
+ * time.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE bytes are carved out of large chunks, one
+ * size class per ALIGN bytes, and freed blocks are kept on a free list per
+ * size class to be handed out again. Nodes that are allocated together thus
+ * end up next to each other in memory, without per-allocation malloc
+ * overhead. Larger blocks, and arrays such as hash buckets, go to operator
+ * new, and are counted separately. Chunks are only released when the
+ * resource is destroyed.
+ *
+ * Not thread safe; the owner of the containers has to serialize access.
+ */
+class CPoolResource
+{
+public:
+    static const size_t ALIGN = 16;
+    static const size_t MAX_BLOCK_SIZE = 512;
+    static const size_t CHUNK_SIZE = 256 * 1024;
+
+private:
+    struct FreeBlock {
+        FreeBlock* pnext;
+    };
+
+    //! Free list per size class, each block being (index + 1) * ALIGN bytes
+    FreeBlock* vFree[MAX_BLOCK_SIZE / ALIGN];
+    std::vector<char*> vChunks;
+    char* pAvailable;
+    char* pAvailableEnd;
+    //! Bytes in blocks that are handed out, rounded up to their size class
+    size_t nBlockBytes;
+    //! malloc usage of the allocations passed to operator new
+    size_t nLargeUsage;
+
+    CPoolResource(const CPoolResource&);
+    CPoolResource& operator=(const CPoolResource&);
+
+    static size_t SizeClass(size_t bytes) { return (bytes + ALIGN - 1) / ALIGN - 1; }
+    static bool IsPooled(size_t bytes, size_t alignment) { return bytes > 0 && bytes <= MAX_BLOCK_SIZE && ALIGN % alignment == 0; }
+
+public:
+    CPoolResource() : pAvailable(NULL), pAvailableEnd(NULL), nBlockBytes(0), nLargeUsage(0)
+    {
+        for (FreeBlock*& pfree : vFree)
+            pfree = NULL;
+    }
+
+    ~CPoolResource()
+    {
+        for (char* pchunk : vChunks)
+            ::operator delete(pchunk);
+    }
+
+    void* Allocate(size_t bytes, size_t alignment, bool fArray = false)
+    {
+        if (fArray || !IsPooled(bytes, alignment)) {
+            nLargeUsage += memusage::MallocUsage(bytes);
+            return ::operator new(bytes);
+        }
+        const size_t nClass = SizeClass(bytes);
+        const size_t nSize = (nClass + 1) * ALIGN;
+        nBlockBytes += nSize;
+        if (vFree[nClass]) {
+            FreeBlock* pblock = vFree[nClass];
+            vFree[nClass] = pblock->pnext;
+            return pblock;
+        }
+        if ((size_t)(pAvailableEnd - pAvailable) < nSize) {
+            // Whatever is left of the current chunk is too small for this
+            // size class; put it on the free list of its own size.
+            const size_t nLeft = pAvailableEnd - pAvailable;
+            if (nLeft > 0) {
+                FreeBlock* pblock = new (pAvailable) FreeBlock;
+                pblock->pnext = vFree[SizeClass(nLeft)];
+                vFree[SizeClass(nLeft)] = pblock;
+            }
+            vChunks.push_back(static_cast<char*>(::operator new(CHUNK_SIZE)));
+            pAvailable = vChunks.back();
+            pAvailableEnd = pAvailable + CHUNK_SIZE;
+        }
+        void* p = pAvailable;
+        pAvailable += nSize;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t alignment, bool fArray = false)
+    {
+        if (fArray || !IsPooled(bytes, alignment)) {
+            nLargeUsage -= memusage::MallocUsage(bytes);
+            ::operator delete(p);
+            return;
+        }
+        const size_t nClass = SizeClass(bytes);
+        nBlockBytes -= (nClass + 1) * ALIGN;
+        FreeBlock* pblock = new (p) FreeBlock;
+        pblock->pnext = vFree[nClass];
+        vFree[nClass] = pblock;
+    }
+
+    //! Memory used by the blocks and large allocations that are currently handed out.
+    size_t DynamicMemoryUsage() const { return nBlockBytes + nLargeUsage; }
+
+    //! Memory used by the blocks that are currently handed out, leaving out arrays.
+    size_t PooledMemoryUsage() const { return nBlockBytes; }
+
+    //! Memory held in chunks, whether handed out or not.
+    size_t ChunkMemoryUsage() const { return vChunks.size() * memusage::MallocUsage(CHUNK_SIZE) + memusage::DynamicUsage(vChunks); }
+};
+
+/**
+ * Allocator drawing from a CPoolResource. A default constructed allocator
+ * uses operator new, so containers outside the pool behave as usual.
+ *
+ * Copies of a container don't inherit the resource: only the owner of the
+ * resource may allocate from it. Moving a container moves the resource along.
+ */
+template <typename T>
+class CPoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+
+    template <typename U>
+    struct rebind {
+        typedef CPoolAllocator<U> other;
+    };
+
+    CPoolAllocator() : resource(NULL) {}
+    explicit CPoolAllocator(CPoolResource* resourceIn) : resource(resourceIn) {}
+    template <typename U>
+    CPoolAllocator(const CPoolAllocator<U>& other) : resource(other.GetResource()) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (!resource)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T), n != 1));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (!resource)
+            ::operator delete(p);
+        else
+            resource->Deallocate(p, n * sizeof(T), alignof(T), n != 1);
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new ((void*)p) U(std::forward<Args>(args)...); }
+    template <typename U>
+    void destroy(U* p) { p->~U(); }
+
+    CPoolAllocator select_on_container_copy_construction() const { return CPoolAllocator(); }
+
+    CPoolResource* GetResource() const { return resource; }
+
+private:
+    CPoolResource* resource;
+};
+
+template <typename T, typename U>
+bool operator==(const CPoolAllocator<T>& a, const CPoolAllocator<U>& b) { return a.GetResource() == b.GetResource(); }
+template <typename T, typename U>
+bool operator!=(const CPoolAllocator<T>& a, const CPoolAllocator<U>& b) { return a.GetResource() != b.GetResource(); }
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -0,0 +1,166 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "undo.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+static std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > ReadHistory(CBlockTreeDB& db, const CScript& script)
+{
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vHistory;
+    CAddressIndexKey key;
+    key.hashScript = GetScriptHash(script);
+    BOOST_CHECK(db.ReadAddressIndex(key, [&](const CAddressIndexKey& keyEntry, const CAddressIndexValue& value) {
+        vHistory.emplace_back(keyEntry, value);
+        return true;
+    }));
+    return vHistory;
+}
+
+static std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > ReadUnspent(CBlockTreeDB& db, const CScript& script)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    CAddressUnspentKey key;
+    key.hashScript = GetScriptHash(script);
+    BOOST_CHECK(db.ReadAddressUnspentIndex(key, [&](const CAddressUnspentKey& keyEntry, const CAddressUnspentValue& value) {
+        vUnspent.emplace_back(keyEntry, value);
+        return true;
+    }));
+    return vUnspent;
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    CBlockTreeDB db(1 << 20, true);
+    const CScript scriptA = CScript() << OP_1;
+    const CScript scriptB = CScript() << OP_2;
+    const CScript scriptC = CScript() << OP_3;
+    const int nHeight = 10;
+
+    // An output paying to B at height 5, which the block spends
+    const COutPoint prevout(uint256S("1234"), 1);
+    const Coin coinPrev(CTxOut(50 * COIN, scriptB), 5, false);
+    CAddressIndexUpdate updatePrev;
+    updatePrev.vUnspent.emplace_back(CAddressUnspentKey(GetScriptHash(scriptB), 5, prevout.hash, prevout.n), CAddressUnspentValue(50 * COIN, false));
+    BOOST_CHECK(db.UpdateAddressIndex(updatePrev, true));
+
+    // Coinbase paying A, tx1 spending the output of B and paying A and C,
+    // tx2 spending the output of tx1 paying A and paying B
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(10 * COIN, scriptA);
+    coinbase.vout.emplace_back(0, CScript() << OP_RETURN);
+    CMutableTransaction tx1;
+    tx1.vin.emplace_back(prevout);
+    tx1.vout.emplace_back(20 * COIN, scriptA);
+    tx1.vout.emplace_back(29 * COIN, scriptC);
+    CMutableTransaction tx2;
+    tx2.vin.emplace_back(COutPoint(tx1.GetHash(), 0));
+    tx2.vout.emplace_back(19 * COIN, scriptB);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(tx1));
+    block.vtx.push_back(MakeTransactionRef(tx2));
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    blockundo.vtxundo[0].vprevout.push_back(coinPrev);
+    blockundo.vtxundo[1].vprevout.push_back(Coin(tx1.vout[0], nHeight, false));
+
+    CAddressIndexUpdate update;
+    GetAddressIndexUpdate(block, blockundo, nHeight, true, update);
+    BOOST_CHECK(db.UpdateAddressIndex(update, true));
+
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vHistory = ReadHistory(db, scriptA);
+    BOOST_REQUIRE_EQUAL(vHistory.size(), 3U);
+    BOOST_CHECK(vHistory[0].second.txid == coinbase.GetHash());
+    BOOST_CHECK_EQUAL(vHistory[0].second.nValue, 10 * COIN);
+    BOOST_CHECK(vHistory[1].second.txid == tx1.GetHash());
+    BOOST_CHECK(!vHistory[1].first.fSpending);
+    BOOST_CHECK(vHistory[2].second.txid == tx2.GetHash());
+    BOOST_CHECK(vHistory[2].first.fSpending);
+    BOOST_CHECK_EQUAL(vHistory[2].first.nHeight, nHeight);
+    BOOST_CHECK_EQUAL(vHistory[2].first.nIndex, 0U);
+    BOOST_CHECK_EQUAL(vHistory[2].second.nValue, 20 * COIN);
+    vHistory = ReadHistory(db, scriptB);
+    BOOST_REQUIRE_EQUAL(vHistory.size(), 2U);
+    BOOST_CHECK(vHistory[0].first.fSpending && vHistory[0].second.txid == tx1.GetHash());
+    BOOST_CHECK(!vHistory[1].first.fSpending && vHistory[1].second.txid == tx2.GetHash());
+
+    // The output of tx1 paying A is spent within the block
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent = ReadUnspent(db, scriptA);
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == coinbase.GetHash());
+    BOOST_CHECK(vUnspent[0].second.fCoinBase);
+    vUnspent = ReadUnspent(db, scriptB);
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == tx2.GetHash());
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 19 * COIN);
+    BOOST_CHECK_EQUAL(ReadUnspent(db, scriptC).size(), 1U);
+
+    // Disconnecting restores the output of B, and nothing else is left
+    GetAddressIndexUpdate(block, blockundo, nHeight, false, update);
+    BOOST_CHECK(db.UpdateAddressIndex(update, false));
+    BOOST_CHECK(ReadHistory(db, scriptA).empty());
+    BOOST_CHECK(ReadHistory(db, scriptB).empty());
+    BOOST_CHECK(ReadUnspent(db, scriptA).empty());
+    BOOST_CHECK(ReadUnspent(db, scriptC).empty());
+    vUnspent = ReadUnspent(db, scriptB);
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == prevout.hash);
+    BOOST_CHECK_EQUAL(vUnspent[0].first.n, 1U);
+    BOOST_CHECK_EQUAL(vUnspent[0].first.nHeight, 5);
+
+    BOOST_CHECK(db.EraseAddressIndex());
+    BOOST_CHECK(ReadUnspent(db, scriptB).empty());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_cursor)
+{
+    CBlockTreeDB db(1 << 20, true);
+    const CScript script = CScript() << OP_1;
+    const uint256 hashScript = GetScriptHash(script);
+
+    // Entries across heights above 255, to check they are kept in order
+    CAddressIndexUpdate update;
+    for (int i = 0; i < 10; i++)
+        update.vHistory.emplace_back(CAddressIndexKey(hashScript, 250 + i * 3, 1, false, 0), CAddressIndexValue(uint256S("1"), i));
+    BOOST_CHECK(db.UpdateAddressIndex(update, true));
+
+    // Read pages of three, continuing from the cursor
+    CAddressIndexKey key;
+    key.hashScript = hashScript;
+    std::vector<CAmount> vValues;
+    std::string strCursor;
+    do {
+        if (!strCursor.empty())
+            BOOST_REQUIRE(DecodeAddressIndexCursor(strCursor, key));
+        strCursor.clear();
+        size_t nEntries = 0;
+        BOOST_CHECK(db.ReadAddressIndex(key, [&](const CAddressIndexKey& keyEntry, const CAddressIndexValue& value) {
+            if (nEntries == 3) {
+                strCursor = EncodeAddressIndexCursor(keyEntry);
+                return false;
+            }
+            nEntries++;
+            vValues.push_back(value.nValue);
+            return true;
+        }));
+    } while (!strCursor.empty());
+    BOOST_REQUIRE_EQUAL(vValues.size(), 10U);
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK_EQUAL(vValues[i], i);
+
+    BOOST_CHECK(!DecodeAddressIndexCursor("zz", key));
+    BOOST_CHECK(!DecodeAddressIndexCursor("00", key));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "auxpow.h"
+#include "auxpowcache.h"
 #include "chainparams.h"
 #include "coins.h"
 #include "consensus/merkle.h"
@@ -443,4 +444,101 @@ BOOST_AUTO_TEST_CASE(auxpow_pow)
 
 /* ************************************************************************** */
 
+BOOST_AUTO_TEST_CASE(header_check)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = Params().GetConsensus(371337);
+
+    const arith_uint256 target = (~arith_uint256(0) >> 1);
+    std::vector<CBlockHeader> headers(20);
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].SetBaseVersion(2, params.nAuxpowChainId);
+        headers[i].nTime = i;
+        headers[i].nBits = target.GetCompact();
+        mineBlock(headers[i], true);
+    }
+
+    /* One merge-mined header with a valid auxpow.  */
+    CAuxpowBuilder builder(5, 42);
+    const int index = CAuxPow::getExpectedIndex(7, params.nAuxpowChainId, 3);
+    headers[3].SetAuxpowFlag(true);
+    const std::vector<unsigned char> auxRoot = builder.buildAuxpowChain(headers[3].GetHash(), 3, index);
+    builder.setCoinbase(CScript() << CAuxpowBuilder::buildCoinbaseData(true, auxRoot, 3, 7));
+    mineBlock(builder.parentBlock, true, headers[3].nBits);
+    headers[3].SetAuxpow(new CAuxPow(builder.get()));
+
+    std::vector<char> vInvalid(headers.size(), 0);
+    CHeaderCheck check(&headers[0], &headers[0] + headers.size(), params, &vInvalid[0]);
+    BOOST_CHECK(check());
+    BOOST_CHECK(std::count(vInvalid.begin(), vInvalid.end(), 0) == (int)headers.size());
+
+    /* Failing PoW and a wrong chain ID are flagged on the right headers.  */
+    mineBlock(headers[5], false);
+    headers[17].SetChainId(params.nAuxpowChainId + 1);
+    mineBlock(headers[17], true);
+    CHeaderCheck check2(&headers[0], &headers[0] + headers.size(), params, &vInvalid[0]);
+    BOOST_CHECK(!check2());
+    for (size_t i = 0; i < headers.size(); i++)
+        BOOST_CHECK_EQUAL(vInvalid[i] != 0, i == 5 || i == 17);
+}
+
+/* ************************************************************************** */
+
+BOOST_AUTO_TEST_CASE(auxpow_cache)
+{
+    CAuxpowBuilder builder(5, 42);
+    std::vector<unsigned char> data(32, 0x42);
+    builder.setCoinbase(CScript() << data);
+    const CAuxPow auxpow = builder.get();
+
+    const uint256 hashA = ArithToUint256(arith_uint256(1));
+    const uint256 hashB = ArithToUint256(arith_uint256(2));
+    const uint256 hashC = ArithToUint256(arith_uint256(3));
+
+    CAuxPowCache cache;
+    boost::shared_ptr<CAuxPow> result;
+    bool fChecked = true;
+    BOOST_CHECK(!cache.Lookup(hashA, result, fChecked));
+    BOOST_CHECK(!result);
+
+    /* Entries round-trip and remember whether their PoW was checked.  */
+    cache.Insert(hashA, auxpow, false);
+    BOOST_CHECK(cache.Lookup(hashA, result, fChecked));
+    BOOST_CHECK(result && result->GetHash() == auxpow.GetHash());
+    BOOST_CHECK(result->parentBlock.GetHash() == auxpow.parentBlock.GetHash());
+    BOOST_CHECK(!fChecked);
+    cache.Insert(hashA, auxpow, true);
+    BOOST_CHECK(cache.Lookup(hashA, result, fChecked));
+    BOOST_CHECK(fChecked);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK_EQUAL(cache.GetHits(), 2U);
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 1U);
+
+    /* Limit the cache to two entries and check LRU eviction.  */
+    const size_t nOneEntry = cache.DynamicMemoryUsage();
+    cache.Insert(hashB, auxpow, true);
+    const size_t nTwoEntries = cache.DynamicMemoryUsage();
+    cache.SetMaxUsage(nTwoEntries + (nTwoEntries - nOneEntry) / 2);
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.Lookup(hashA, result, fChecked));
+    cache.Insert(hashC, auxpow, true);
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.Lookup(hashA, result, fChecked));
+    BOOST_CHECK(!cache.Lookup(hashB, result, fChecked));
+    BOOST_CHECK(cache.Lookup(hashC, result, fChecked));
+
+    cache.Erase(hashA);
+    BOOST_CHECK(!cache.Lookup(hashA, result, fChecked));
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    BOOST_CHECK(!cache.Lookup(hashC, result, fChecked));
+
+    /* A zero-sized cache stores nothing.  */
+    cache.SetMaxUsage(0);
+    cache.Insert(hashA, auxpow, true);
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+
+/* ************************************************************************** */
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "streams.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestChain240Setup)
+
+static std::vector<unsigned char> SerializeBlock(const CBlock& block)
+{
+    std::vector<unsigned char> vch;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, vch, 0, block);
+    return vch;
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_read)
+{
+    const CChainParams& chainparams = Params();
+    LOCK(cs_main);
+
+    // Read every block through the map and through a FILE*
+    for (int i = 0; i <= chainActive.Height(); i++) {
+        CBlockIndex* pindex = chainActive[i];
+        const Consensus::Params& params = chainparams.GetConsensus(i);
+
+        blockFileMap.SetMaxFiles(DEFAULT_BLOCKFILE_MAPS);
+        CBlock blockMapped;
+        BOOST_CHECK(ReadBlockFromDisk(blockMapped, pindex, params));
+        std::vector<unsigned char> vchRaw;
+        BOOST_CHECK(ReadRawBlockFromDisk(vchRaw, pindex));
+
+        blockFileMap.SetMaxFiles(0);
+        CBlock blockFile;
+        BOOST_CHECK(ReadBlockFromDisk(blockFile, pindex, params));
+        std::vector<unsigned char> vchRawFile;
+        BOOST_CHECK(ReadRawBlockFromDisk(vchRawFile, pindex));
+
+        BOOST_CHECK(blockMapped.GetHash() == pindex->GetBlockHash());
+        BOOST_CHECK(SerializeBlock(blockMapped) == SerializeBlock(blockFile));
+        BOOST_CHECK(vchRaw == SerializeBlock(blockFile));
+        BOOST_CHECK(vchRawFile == vchRaw);
+    }
+    blockFileMap.SetMaxFiles(DEFAULT_BLOCKFILE_MAPS);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_grow)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<CMutableTransaction> noTxns;
+
+    // Map the block file, then extend it
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, chainActive.Tip(), chainparams.GetConsensus(chainActive.Height())));
+    const uint64_t nMaps = blockFileMap.GetMaps();
+    for (int i = 0; i < 10; i++)
+        CreateAndProcessBlock(noTxns, scriptPubKey);
+
+    // Blocks and undo data written since then can be read back, through a new mapping if needed
+    LOCK(cs_main);
+    std::vector<unsigned char> vchRaw;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchRaw, chainActive.Tip()));
+    BOOST_CHECK(ReadBlockFromDisk(block, chainActive.Tip(), chainparams.GetConsensus(chainActive.Height())));
+    BOOST_CHECK(vchRaw == SerializeBlock(block));
+    BOOST_CHECK(blockFileMap.GetMaps() >= nMaps);
+    BOOST_CHECK(CVerifyDB().VerifyDB(chainparams, pcoinsTip, 3, 50));
+
+    // Mappings are dropped for files that are truncated or pruned
+    blockFileMap.Invalidate(chainActive.Tip()->GetBlockPos().nFile);
+    BOOST_CHECK_EQUAL(blockFileMap.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
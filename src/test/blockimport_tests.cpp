@@ -0,0 +1,69 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "streams.h"
+#include "txdb.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, TestChain240Setup)
+
+// Write the active chain to an external block file in shuffled order, start
+// over from an empty block index and import it again.
+BOOST_AUTO_TEST_CASE(blockimport_out_of_order)
+{
+    const CChainParams& chainparams = Params();
+    const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    const int nHeight = chainActive.Height();
+
+    std::vector<CBlock> vBlocks;
+    for (int i = 1; i <= nHeight; i++) {
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, chainActive[i], chainparams.GetConsensus(i)));
+        vBlocks.push_back(block);
+    }
+    std::random_shuffle(vBlocks.begin(), vBlocks.end(), GetRandInt);
+
+    boost::filesystem::path path = GetDataDir() / "bootstrap.dat";
+    {
+        CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(!fileout.IsNull());
+        // Junk between the records has to be skipped
+        fileout << (uint32_t)0xdeadbeef;
+        for (const CBlock& block : vBlocks) {
+            fileout << FLATDATA(chainparams.MessageStart());
+            fileout << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            fileout << block;
+            fileout << (uint8_t)0;
+        }
+    }
+
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    delete pcoinsdbview;
+    delete pblocktree;
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    BOOST_CHECK(InitBlockIndex(chainparams));
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+
+    FILE* file = fopen(path.string().c_str(), "rb");
+    BOOST_CHECK(file != NULL);
+    BOOST_CHECK(LoadExternalBlockFile(chainparams, file));
+
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -128,6 +128,17 @@ BOOST_AUTO_TEST_CASE(siphash)
     tx.nVersion = 1;
     ss << tx;
     BOOST_CHECK_EQUAL(SipHashUint256(1, 2, ss.GetHash()), 0x79751e980c2a0a35ULL);
+
+    // Check the extended uint256 variant against the generic hasher, which
+    // writes the 4 extra bytes after the 32 bytes of the uint256
+    const uint256 val = uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    for (uint32_t extra = 0; extra < 256; extra += 17) {
+        CSipHasher hasher4(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
+        hasher4.Write(val.begin(), 32);
+        unsigned char extrabytes[4] = {(unsigned char)extra, 0, 0, 0};
+        hasher4.Write(extrabytes, 4);
+        BOOST_CHECK_EQUAL(SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, val, extra), hasher4.Finalize());
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
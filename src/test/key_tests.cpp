@@ -6,6 +6,7 @@
 
 #include "base58.h"
 #include "script/script.h"
+#include "script/sigcache.h"
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -185,4 +186,39 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsigc == ParseHex("20af874275fc12e344969ed4ec89cd1f4974ec816d63391f0e002d3fb81a22c25e00edcf093fdf460f45d9a3ca918d321a21539dac276f8d81a64818c62e8e9517"));
 }
 
+BOOST_AUTO_TEST_CASE(key_parsed_verify)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = GetRandHash(), hashOther = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+
+    CParsedPubKey parsed;
+    BOOST_CHECK(pubkey.Parse(parsed));
+    BOOST_CHECK(CPubKey::VerifyParsed(parsed, hash, vchSig));
+    BOOST_CHECK(!CPubKey::VerifyParsed(parsed, hashOther, vchSig));
+    BOOST_CHECK(!CPubKey::VerifyParsed(parsed, hash, std::vector<unsigned char>()));
+    BOOST_CHECK(!CPubKey().Parse(parsed));
+
+    // The cache gives the same results, parsing each key once
+    CPubKeyParseCache pubkeycache;
+    CPubKey pubkeyUncompressed = pubkey;
+    BOOST_CHECK(pubkeyUncompressed.Decompress());
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(pubkeycache.Verify(pubkey, hash, vchSig));
+        BOOST_CHECK(pubkeycache.Verify(pubkeyUncompressed, hash, vchSig));
+        BOOST_CHECK(!pubkeycache.Verify(pubkey, hashOther, vchSig));
+    }
+    BOOST_CHECK_EQUAL(pubkeycache.Size(), 2U);
+    BOOST_CHECK_EQUAL(pubkeycache.GetHits(), 4U);
+
+    // There is no point with x = 0
+    std::vector<unsigned char> vchInvalid(33, 0);
+    vchInvalid[0] = 0x02;
+    BOOST_CHECK(!pubkeycache.Verify(CPubKey(vchInvalid), hash, vchSig));
+    BOOST_CHECK_EQUAL(pubkeycache.Size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
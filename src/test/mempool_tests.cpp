@@ -584,4 +584,225 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolEntryLinksTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    size_t nEmptyUsage = pool.DynamicMemoryUsage();
+
+    // A parent with two children, and a grandchild spending both
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild[2];
+    for (int i = 0; i < 2; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txGrandChild.vin[i].scriptSig = CScript() << OP_11;
+        txGrandChild.vin[i].prevout = COutPoint(txChild[i].GetHash(), 0);
+    }
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 11000LL;
+
+    size_t nFullUsage = 0;
+    for (int round = 0; round < 2; round++) {
+        pool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+        pool.addUnchecked(txChild[0].GetHash(), entry.FromTx(txChild[0]));
+        pool.addUnchecked(txChild[1].GetHash(), entry.FromTx(txChild[1]));
+        pool.addUnchecked(txGrandChild.GetHash(), entry.FromTx(txGrandChild));
+
+        LOCK(pool.cs);
+        CTxMemPool::txiter parentIt = pool.mapTx.find(txParent.GetHash());
+        CTxMemPool::txiter grandChildIt = pool.mapTx.find(txGrandChild.GetHash());
+        BOOST_CHECK_EQUAL(pool.GetMemPoolParents(parentIt).size(), 0U);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(parentIt).size(), 2U);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolParents(grandChildIt).size(), 2U);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(grandChildIt).size(), 0U);
+        for (const CTxMemPoolEntry& child : pool.GetMemPoolChildren(parentIt)) {
+            BOOST_CHECK(pool.GetMemPoolParents(pool.mapTx.iterator_to(child)).count(*parentIt));
+            BOOST_CHECK(pool.GetMemPoolChildren(pool.mapTx.iterator_to(child)).count(*grandChildIt));
+        }
+        BOOST_CHECK_EQUAL(grandChildIt->GetCountWithAncestors(), 4U);
+        BOOST_CHECK_EQUAL(parentIt->GetCountWithDescendants(), 4U);
+
+        // A copy of an entry doesn't carry its links along
+        CTxMemPoolEntry copy(*parentIt);
+        BOOST_CHECK(copy.GetMemPoolChildrenConst().empty());
+
+        // Usage is exact: the same transactions always take the same memory,
+        // and all of it is given back when they leave
+        BOOST_CHECK(pool.DynamicMemoryUsage() > nEmptyUsage);
+        if (round == 0)
+            nFullUsage = pool.DynamicMemoryUsage();
+        BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nFullUsage);
+
+        pool.removeRecursive(txChild[1]);
+        BOOST_CHECK_EQUAL(pool.size(), 2U);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(parentIt).size(), 1U);
+        pool.removeRecursive(txParent);
+        BOOST_CHECK_EQUAL(pool.size(), 0U);
+        if (round == 0)
+            nEmptyUsage = pool.DynamicMemoryUsage();
+        BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nEmptyUsage);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolUpdateFromBlockTest)
+{
+    // A block holding txA, which fans out to txB1 and txB2, gets disconnected.
+    // txC spends both txB1 and txB2, and txD spends txC; they stayed in the
+    // mempool.
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+
+    CMutableTransaction txA;
+    txA.vin.resize(1);
+    txA.vin[0].scriptSig = CScript() << OP_11;
+    txA.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txA.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txA.vout[i].nValue = 10 * COIN;
+    }
+    CMutableTransaction txB[2];
+    for (int i = 0; i < 2; i++) {
+        txB[i].vin.resize(1);
+        txB[i].vin[0].scriptSig = CScript() << OP_11;
+        txB[i].vin[0].prevout = COutPoint(txA.GetHash(), i);
+        txB[i].vout.resize(1);
+        txB[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txB[i].vout[0].nValue = 10 * COIN;
+    }
+    CMutableTransaction txC;
+    txC.vin.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txC.vin[i].scriptSig = CScript() << OP_11;
+        txC.vin[i].prevout = COutPoint(txB[i].GetHash(), 0);
+    }
+    txC.vout.resize(1);
+    txC.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txC.vout[0].nValue = 10 * COIN;
+    CMutableTransaction txD;
+    txD.vin.resize(1);
+    txD.vin[0].scriptSig = CScript() << OP_11;
+    txD.vin[0].prevout = COutPoint(txC.GetHash(), 0);
+    txD.vout.resize(1);
+    txD.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txD.vout[0].nValue = 10 * COIN;
+
+    pool.addUnchecked(txC.GetHash(), entry.Fee(1000LL).FromTx(txC));
+    pool.addUnchecked(txD.GetHash(), entry.Fee(2000LL).FromTx(txD));
+    // The block's transactions come back in block order
+    pool.addUnchecked(txA.GetHash(), entry.Fee(3000LL).FromTx(txA));
+    pool.addUnchecked(txB[0].GetHash(), entry.Fee(4000LL).FromTx(txB[0]));
+    pool.addUnchecked(txB[1].GetHash(), entry.Fee(5000LL).FromTx(txB[1]));
+    std::vector<uint256> vHashUpdate = {txA.GetHash(), txB[0].GetHash(), txB[1].GetHash()};
+    pool.UpdateTransactionsFromBlock(vHashUpdate);
+
+    LOCK(pool.cs);
+    CTxMemPool::txiter itA = pool.mapTx.find(txA.GetHash());
+    CTxMemPool::txiter itC = pool.mapTx.find(txC.GetHash());
+    CTxMemPool::txiter itD = pool.mapTx.find(txD.GetHash());
+    BOOST_CHECK_EQUAL(itA->GetCountWithDescendants(), 5U);
+    BOOST_CHECK_EQUAL(itA->GetModFeesWithDescendants(), 15000LL);
+    for (int i = 0; i < 2; i++) {
+        CTxMemPool::txiter itB = pool.mapTx.find(txB[i].GetHash());
+        BOOST_CHECK_EQUAL(itB->GetCountWithDescendants(), 3U);
+        BOOST_CHECK_EQUAL(itB->GetCountWithAncestors(), 2U);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(itB).size(), 1U);
+    }
+    BOOST_CHECK_EQUAL(pool.GetMemPoolParents(itC).size(), 2U);
+    BOOST_CHECK_EQUAL(itC->GetCountWithAncestors(), 4U);
+    BOOST_CHECK_EQUAL(itC->GetModFeesWithAncestors(), 13000LL);
+    BOOST_CHECK_EQUAL(itD->GetCountWithAncestors(), 5U);
+    BOOST_CHECK_EQUAL(itD->GetSizeWithAncestors(), itA->GetSizeWithDescendants());
+
+    // The walks agree with the updated state
+    CTxMemPool::setEntries setDescendants, setAncestors;
+    pool.CalculateDescendants(itA, setDescendants);
+    BOOST_CHECK_EQUAL(setDescendants.size(), 5U);
+    std::string dummy;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*itD, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 4U);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*itD, setAncestors, 4, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+
+    // A child paying more than its parent, so that only the ancestor count
+    // keeps the parent in front
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 10 * COIN;
+
+    std::shared_ptr<const CTxMemPoolSnapshot> empty = pool.GetSnapshot();
+    BOOST_CHECK(empty->vEntries.empty());
+    BOOST_CHECK(pool.GetSnapshot() == empty);
+
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(100000LL).FromTx(txChild));
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = pool.GetSnapshot();
+    BOOST_CHECK(snapshot != empty);
+    BOOST_CHECK(empty->vEntries.empty());
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 2U);
+    BOOST_CHECK_EQUAL(snapshot->vSortedDepthAndScore.size(), 2U);
+    const CTxMemPoolSnapshot::Entry& parent = snapshot->vEntries[snapshot->vSortedDepthAndScore[0]];
+    const CTxMemPoolSnapshot::Entry& child = snapshot->vEntries[snapshot->vSortedDepthAndScore[1]];
+    BOOST_CHECK(parent.GetTxid() == txParent.GetHash());
+    BOOST_CHECK(parent.vParents.empty());
+    BOOST_CHECK(child.GetTxid() == txChild.GetHash());
+    BOOST_CHECK_EQUAL(child.vParents.size(), 1U);
+    BOOST_CHECK(child.vParents[0] == txParent.GetHash());
+    BOOST_CHECK_EQUAL(child.entry.GetCountWithAncestors(), 2U);
+
+    std::vector<uint256> vtxid;
+    pool.queryHashes(vtxid);
+    BOOST_CHECK_EQUAL(vtxid.size(), 2U);
+    BOOST_CHECK(vtxid[0] == txParent.GetHash());
+    std::vector<TxMempoolInfo> vInfo = pool.infoAll();
+    BOOST_CHECK_EQUAL(vInfo.size(), 2U);
+    BOOST_CHECK(vInfo[1].tx->GetHash() == txChild.GetHash());
+
+    // A fee delta is picked up by the next snapshot, and the one handed out
+    // before stays as it was
+    pool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, 5000LL);
+    std::shared_ptr<const CTxMemPoolSnapshot> prioritised = pool.GetSnapshot();
+    BOOST_CHECK(prioritised != snapshot);
+    BOOST_CHECK_EQUAL(parent.entry.GetModifiedFee(), 1000LL);
+    BOOST_CHECK_EQUAL(prioritised->vEntries[prioritised->vSortedDepthAndScore[0]].entry.GetModifiedFee(), 6000LL);
+
+    pool.removeRecursive(txParent);
+    BOOST_CHECK(pool.GetSnapshot()->vEntries.empty());
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -496,4 +496,72 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(BlockTemplateBuilder_updates, TestChain240Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlockTemplateBuilder builder(chainparams);
+    TestMemPoolEntryHelper entry;
+    entry.nFee = COIN;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = builder.GetBlockTemplate(scriptPubKey, false, 60);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+    const CAmount nSubsidy = pblocktemplate->block.vtx[0]->vout[0].nValue;
+
+    // A mature coinbase spend, and a child of it
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx.GetHash(), 0);
+    tx2.vout.resize(1);
+    tx2.vout[0].nValue = tx.vout[0].nValue - COIN;
+    tx2.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    // Both get appended to the template, parent first
+    mempool.addUnchecked(tx.GetHash(), entry.SpendsCoinbase(true).FromTx(tx));
+    mempool.addUnchecked(tx2.GetHash(), entry.SpendsCoinbase(false).FromTx(tx2));
+    pblocktemplate = builder.GetBlockTemplate(scriptPubKey, false, 60);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == tx.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == tx2.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, nSubsidy + 2 * COIN);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -2 * COIN);
+
+    // The same as assembling it from scratch
+    std::unique_ptr<CBlockTemplate> pfulltemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey, false);
+    BOOST_CHECK_EQUAL(pfulltemplate->block.vtx.size(), 3);
+    BOOST_CHECK_EQUAL(pfulltemplate->block.vtx[0]->vout[0].nValue, pblocktemplate->block.vtx[0]->vout[0].nValue);
+    {
+        CValidationState state;
+        LOCK(cs_main);
+        BOOST_CHECK(TestBlockValidity(state, chainparams, pblocktemplate->block, chainActive.Tip(), false, false));
+    }
+
+    // Leaving the mempool takes them out again
+    mempool.removeRecursive(tx);
+    pblocktemplate = builder.GetBlockTemplate(scriptPubKey, false, 60);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, nSubsidy);
+
+    // A new tip gives a new template without what it confirmed
+    mempool.addUnchecked(tx.GetHash(), entry.SpendsCoinbase(true).FromTx(tx));
+    BOOST_CHECK_EQUAL(builder.GetBlockTemplate(scriptPubKey, false, 60)->block.vtx.size(), 2);
+    std::vector<CMutableTransaction> vtx(1, tx);
+    CBlock block = CreateAndProcessBlock(vtx, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    pblocktemplate = builder.GetBlockTemplate(scriptPubKey, false, 60);
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock == block.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "crypto/scrypt.h"
+#include "primitives/pureheader.h"
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -32,4 +33,66 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_multi)
+{
+    // Hash batches of every size up to a few times the widest lane count, so
+    // that full groups, padded partial groups and the single-lane remainder
+    // are all compared against the generic implementation.
+    static const size_t MAX_COUNT = 35;
+    std::vector<char> input(MAX_COUNT * 80);
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = (char)(i * 7 + i / 80);
+
+    std::vector<char> expected(MAX_COUNT * 32);
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < MAX_COUNT; i++)
+        scrypt_1024_1_1_256_sp_generic(&input[i * 80], &expected[i * 32], scratchpad);
+
+    scrypt_detect_multiway();
+    for (size_t count = 0; count <= MAX_COUNT; count++) {
+        std::vector<char> output(count * 32 + 1, 0x5a);
+        scrypt_1024_1_1_256_multi(count ? &input[0] : NULL, &output[0], count);
+        BOOST_CHECK(std::equal(output.begin(), output.begin() + count * 32, expected.begin()));
+        BOOST_CHECK_EQUAL(output[count * 32], 0x5a);
+    }
+
+#if defined(ENABLE_AVX2) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) {
+        std::vector<char> output(8 * 32), avxpad(SCRYPT_SCRATCHPAD_SIZE_AVX2);
+        scrypt_1024_1_1_256_sp_avx2_8way(&input[0], &output[0], &avxpad[0]);
+        BOOST_CHECK(std::equal(output.begin(), output.end(), expected.begin()));
+    }
+#endif
+#if defined(ENABLE_AVX512) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx512f")) {
+        std::vector<char> output(16 * 32), avxpad(SCRYPT_SCRATCHPAD_SIZE_AVX512);
+        scrypt_1024_1_1_256_sp_avx512_16way(&input[0], &output[0], &avxpad[0]);
+        BOOST_CHECK(std::equal(output.begin(), output.end(), expected.begin()));
+    }
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(pow_hash_batch)
+{
+    std::vector<CPureBlockHeader> headers(11);
+    std::vector<const CPureBlockHeader*> pheaders;
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].nVersion = 2;
+        headers[i].nTime = 1386474927 + i;
+        headers[i].nBits = 0x1e0ffff0;
+        headers[i].nNonce = i * 1000;
+        pheaders.push_back(&headers[i]);
+    }
+
+    std::vector<uint256> hashes;
+    CPureBlockHeader::GetPoWHashBatch(pheaders, hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++)
+        BOOST_CHECK(hashes[i] == headers[i].GetPoWHash());
+
+    pheaders.clear();
+    CPureBlockHeader::GetPoWHashBatch(pheaders, hashes);
+    BOOST_CHECK(hashes.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
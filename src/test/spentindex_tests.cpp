@@ -0,0 +1,77 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/sign.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(spentindex_tests, TestChain240Setup)
+
+BOOST_AUTO_TEST_CASE(spentindex_connect_disconnect)
+{
+    fSpentIndex = true;
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A spend of a mature coinbase, and a spend of its output within the block
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx1.vout.resize(1);
+    tx1.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - COIN;
+    tx1.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx1, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx1.vin[0].scriptSig << vchSig;
+
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vout.resize(1);
+    tx2.vout[0].nValue = tx1.vout[0].nValue - COIN;
+    tx2.vout[0].scriptPubKey = scriptPubKey;
+    vchSig.clear();
+    hash = SignatureHash(scriptPubKey, tx2, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx2.vin[0].scriptSig << vchSig;
+
+    std::vector<CMutableTransaction> txns;
+    txns.push_back(tx1);
+    txns.push_back(tx2);
+    CBlock block = CreateAndProcessBlock(txns, scriptPubKey);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    const int nHeight = chainActive.Height();
+
+    CSpentIndexValue value;
+    BOOST_REQUIRE(pblocktree->ReadSpentIndex(tx1.vin[0].prevout, value));
+    BOOST_CHECK(value.txid == tx1.GetHash());
+    BOOST_CHECK_EQUAL(value.nInputIndex, 0U);
+    BOOST_CHECK_EQUAL(value.nHeight, nHeight);
+    BOOST_REQUIRE(pblocktree->ReadSpentIndex(tx2.vin[0].prevout, value));
+    BOOST_CHECK(value.txid == tx2.GetHash());
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(COutPoint(tx2.GetHash(), 0), value));
+
+    // Disconnecting the block drops its spends again
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight - 1);
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(tx1.vin[0].prevout, value));
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(tx2.vin[0].prevout, value));
+
+    fSpentIndex = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,62 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "txindex.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestChain240Setup)
+
+static bool ReadIndexedTx(const CTxIndex& index, const uint256& txid, CTransactionRef& tx)
+{
+    CDiskTxPos pos;
+    if (!index.FindTx(txid, pos))
+        return false;
+    CAutoFile file(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+    CBlockHeader header;
+    file >> header;
+    fseek(file.Get(), pos.nTxOffset, SEEK_CUR);
+    file >> tx;
+    return tx->GetHash() == txid;
+}
+
+BOOST_AUTO_TEST_CASE(txindex_sync)
+{
+    CTxIndex index(1 << 20, true);
+    BOOST_CHECK(index.Init());
+    BOOST_CHECK(index.GetBestBlock() == NULL);
+    BOOST_CHECK(!index.IsSynced());
+
+    // The index catches up with the chain built before it was enabled
+    BOOST_CHECK(index.Sync());
+    BOOST_CHECK(index.IsSynced());
+    BOOST_CHECK(index.GetBestBlock() == chainActive.Tip());
+    CTransactionRef tx;
+    for (const CTransaction& coinbase : coinbaseTxns) {
+        BOOST_REQUIRE(ReadIndexedTx(index, coinbase.GetHash(), tx));
+        BOOST_CHECK(*tx == coinbase);
+    }
+
+    // And indexes blocks connected afterwards on the next sync
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    BOOST_CHECK(!ReadIndexedTx(index, block.vtx[0]->GetHash(), tx));
+    BOOST_CHECK(index.Sync());
+    BOOST_CHECK(index.GetBestBlock() == chainActive.Tip());
+    BOOST_CHECK(ReadIndexedTx(index, block.vtx[0]->GetHash(), tx));
+
+    // The genesis coinbase is not indexed
+    BOOST_CHECK(!ReadIndexedTx(index, chainActive.Genesis()->hashMerkleRoot, tx));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,150 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txmempool.h"
+#include "txrelay.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(txrelay_tests, BasicTestingSetup)
+
+static CMutableTransaction CreateTx(const uint256& prevHash, uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(prevHash, n);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    return tx;
+}
+
+static std::vector<uint256> Announced(const CTxRelayQueue& queue, uint64_t& nSequence, size_t nMax = 1000)
+{
+    std::vector<uint256> vAnnounced;
+    nSequence = queue.ForEachFrom(nSequence, [&](const CTxRelayQueue::Announcement& announcement) {
+        if (vAnnounced.size() >= nMax)
+            return false;
+        vAnnounced.push_back(announcement.tx->GetHash());
+        return true;
+    });
+    return vAnnounced;
+}
+
+BOOST_AUTO_TEST_CASE(TxRelayOrderTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    CTxRelayQueue queue(pool);
+
+    // A child with a high fee, its parent with a low fee, and an unrelated
+    // transaction with a medium fee, relayed child first
+    CMutableTransaction txParent = CreateTx(uint256S("1"), 0);
+    CMutableTransaction txChild = CreateTx(txParent.GetHash(), 0);
+    CMutableTransaction txOther = CreateTx(uint256S("2"), 0);
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000).FromTx(txParent));
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(30000).FromTx(txChild));
+    pool.addUnchecked(txOther.GetHash(), entry.Fee(2000).FromTx(txOther));
+
+    uint64_t nSequence = queue.GetEndSequence();
+    queue.Add(txChild.GetHash());
+    queue.Add(txOther.GetHash());
+    queue.Add(txParent.GetHash());
+    // A transaction that isn't in the mempool isn't announced
+    queue.Add(uint256S("3"));
+
+    // The first batch goes out right away, the next one after the interval
+    queue.Update(1000);
+    BOOST_CHECK_EQUAL(queue.size(), 3U);
+    std::vector<uint256> vAnnounced = Announced(queue, nSequence);
+    BOOST_REQUIRE_EQUAL(vAnnounced.size(), 3U);
+    BOOST_CHECK(vAnnounced[0] == txOther.GetHash());
+    BOOST_CHECK(vAnnounced[1] == txParent.GetHash());
+    BOOST_CHECK(vAnnounced[2] == txChild.GetHash());
+    BOOST_CHECK_EQUAL(nSequence, queue.GetEndSequence());
+
+    CMutableTransaction txLate = CreateTx(uint256S("4"), 0);
+    pool.addUnchecked(txLate.GetHash(), entry.Fee(1000).FromTx(txLate));
+    queue.Add(txLate.GetHash());
+    queue.Update(1000 + TX_RELAY_BATCH_INTERVAL - 1);
+    BOOST_CHECK(Announced(queue, nSequence).empty());
+    queue.Update(1000 + TX_RELAY_BATCH_INTERVAL);
+    vAnnounced = Announced(queue, nSequence);
+    BOOST_REQUIRE_EQUAL(vAnnounced.size(), 1U);
+    BOOST_CHECK(vAnnounced[0] == txLate.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(TxRelaySequenceTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    CTxRelayQueue queue(pool);
+
+    std::vector<CMutableTransaction> vTx;
+    for (int i = 0; i < 4; i++) {
+        vTx.push_back(CreateTx(uint256S("1"), i));
+        pool.addUnchecked(vTx.back().GetHash(), entry.Fee(4000 - 1000 * i).FromTx(vTx.back()));
+        queue.Add(vTx.back().GetHash());
+    }
+    queue.Update(0, true);
+
+    // A peer that is limited resumes where it stopped
+    uint64_t nSequence = 0;
+    std::vector<uint256> vAnnounced = Announced(queue, nSequence, 2);
+    BOOST_REQUIRE_EQUAL(vAnnounced.size(), 2U);
+    BOOST_CHECK(vAnnounced[1] == vTx[1].GetHash());
+    BOOST_CHECK_EQUAL(nSequence, 2U);
+
+    // Transactions that left the mempool are skipped
+    pool.removeRecursive(vTx[2]);
+    vAnnounced = Announced(queue, nSequence);
+    BOOST_REQUIRE_EQUAL(vAnnounced.size(), 1U);
+    BOOST_CHECK(vAnnounced[0] == vTx[3].GetHash());
+
+    // A peer that connects now only gets what is relayed from now on, which
+    // includes a transaction relayed again
+    uint64_t nSequenceNew = queue.GetEndSequence();
+    BOOST_CHECK(Announced(queue, nSequenceNew).empty());
+    queue.Add(vTx[0].GetHash());
+    queue.Update(0, true);
+    BOOST_CHECK_EQUAL(queue.size(), 5U);
+    vAnnounced = Announced(queue, nSequenceNew);
+    BOOST_REQUIRE_EQUAL(vAnnounced.size(), 1U);
+    BOOST_CHECK(vAnnounced[0] == vTx[0].GetHash());
+    // and is only announced once, at its new place
+    uint64_t nSequenceAll = 0;
+    vAnnounced = Announced(queue, nSequenceAll);
+    BOOST_REQUIRE_EQUAL(vAnnounced.size(), 3U);
+    BOOST_CHECK(vAnnounced[0] == vTx[1].GetHash());
+    BOOST_CHECK(vAnnounced[1] == vTx[3].GetHash());
+    BOOST_CHECK(vAnnounced[2] == vTx[0].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(TxRelayLimitTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    CTxRelayQueue queue(pool);
+
+    CMutableTransaction tx = CreateTx(uint256S("1"), 0);
+    pool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+    for (size_t i = 0; i < MAX_TX_RELAY_ANNOUNCEMENTS + 10; i++) {
+        queue.Add(tx.GetHash());
+        queue.Update(0, true);
+    }
+    BOOST_CHECK_EQUAL(queue.size(), MAX_TX_RELAY_ANNOUNCEMENTS);
+
+    // A peer that fell behind goes on with the oldest announcement left
+    uint64_t nSequence = 0;
+    std::vector<uint256> vAnnounced = Announced(queue, nSequence);
+    BOOST_REQUIRE_EQUAL(vAnnounced.size(), 1U);
+    BOOST_CHECK(vAnnounced[0] == tx.GetHash());
+    BOOST_CHECK_EQUAL(nSequence, MAX_TX_RELAY_ANNOUNCEMENTS + 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
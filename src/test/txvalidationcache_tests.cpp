@@ -6,6 +6,7 @@
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
+#include "policy/policy.h"
 #include "pubkey.h"
 #include "txmempool.h"
 #include "random.h"
@@ -84,4 +85,119 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain240Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_script_execution_cache, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = COIN;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    const CTransaction tx(spend);
+    PrecomputedTransactionData txdata(tx);
+
+    LOCK(cs_main);
+
+    // A view in which the spent output can't be spent by any scriptSig, so
+    // that CheckInputs only succeeds if it skips the scripts.
+    CCoinsView viewDummy;
+    CCoinsViewCache viewUnspendable(&viewDummy);
+    viewUnspendable.SetBestBlock(chainActive.Tip()->GetBlockHash());
+    viewUnspendable.AddCoin(spend.vin[0].prevout, Coin(CTxOut(coinbaseTxns[0].vout[0].nValue, CScript() << OP_FALSE), 1, false), false);
+
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    CValidationState state;
+    BOOST_CHECK(!CheckInputs(tx, state, viewUnspendable, true, flags, false, false, txdata));
+
+    // Once the scripts passed with the real coin, the result is cached, for these flags only.
+    BOOST_CHECK(CheckInputs(tx, state, *pcoinsTip, true, flags, true, true, txdata));
+    BOOST_CHECK(CheckInputs(tx, state, viewUnspendable, true, flags, false, false, txdata));
+    BOOST_CHECK(!CheckInputs(tx, state, viewUnspendable, true, flags | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, false, false, txdata));
+
+    // The caches survive a dump and load, and a file of another version is ignored.
+    DumpScriptCaches();
+    BOOST_CHECK(LoadScriptCaches());
+    BOOST_CHECK(CheckInputs(tx, state, viewUnspendable, true, flags, false, false, txdata));
+    {
+        CAutoFile file(fopen((GetDataDir() / "scriptcache.dat").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        file << (uint64_t)0;
+    }
+    BOOST_CHECK(!LoadScriptCaches());
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_preverify, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A spend of a mature coinbase, a child of that spend, and a spend of
+    // another coinbase with a signature for the wrong transaction
+    std::vector<CMutableTransaction> spends(3);
+    spends[0].vin.resize(1);
+    spends[0].vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spends[1].vin.resize(1);
+    spends[2].vin.resize(1);
+    spends[2].vin[0].prevout = COutPoint(coinbaseTxns[1].GetHash(), 0);
+    for (int i = 0; i < 3; i++)
+    {
+        if (i == 1)
+            spends[1].vin[0].prevout = COutPoint(spends[0].GetHash(), 0);
+        spends[i].nVersion = 1;
+        spends[i].vout.resize(1);
+        spends[i].vout[0].nValue = coinbaseTxns[0].vout[0].nValue - (i + 1) * COIN;
+        spends[i].vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, spends[i == 2 ? 0 : i], 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spends[i].vin[0].scriptSig << vchSig;
+    }
+
+    // Whether the scripts of tx were found valid with the mempool's flags:
+    // CheckInputs only passes in a view where the spent output can't be
+    // spent by any scriptSig if it skips the scripts.
+    auto ScriptsCached = [](const CMutableTransaction& mtx) {
+        const CTransaction tx(mtx);
+        PrecomputedTransactionData txdata(tx);
+        CCoinsView viewDummy;
+        CCoinsViewCache viewUnspendable(&viewDummy);
+        viewUnspendable.SetBestBlock(chainActive.Tip()->GetBlockHash());
+        viewUnspendable.AddCoin(tx.vin[0].prevout, Coin(CTxOut(tx.GetValueOut() + COIN, CScript() << OP_FALSE), 1, false), false);
+        CValidationState state;
+        return CheckInputs(tx, state, viewUnspendable, true, STANDARD_SCRIPT_VERIFY_FLAGS, false, true, txdata);
+    };
+
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(!ScriptsCached(spends[i]));
+        vtx.push_back(MakeTransactionRef(spends[i]));
+    }
+
+    // The child's input is found in the batch, before its parent is in the
+    // mempool; the invalid spend is left for AcceptToMemoryPool to reject.
+    PreVerifyTransactions(mempool, vtx);
+    BOOST_CHECK(ScriptsCached(spends[0]));
+    BOOST_CHECK(ScriptsCached(spends[1]));
+    BOOST_CHECK(!ScriptsCached(spends[2]));
+
+    BOOST_CHECK(ToMemPool(spends[0]));
+    BOOST_CHECK(ToMemPool(spends[1]));
+    BOOST_CHECK(!ToMemPool(spends[2]));
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+
+    // A single transaction is verified by the calling thread
+    mempool.clear();
+    PreVerifyTransactions(mempool, std::vector<CTransactionRef>(1, vtx[0]));
+    BOOST_CHECK(ScriptsCached(spends[0]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
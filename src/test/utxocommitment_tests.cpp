@@ -0,0 +1,77 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/sign.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxocommitment_tests, TestChain240Setup)
+
+//! Check the commitment of the tip against a scan of the coin database
+static void CheckTipCommitment()
+{
+    LOCK(cs_main);
+    FlushStateToDisk();
+    std::unique_ptr<CCoinsViewDBSnapshot> snapshot(pcoinsdbview->Snapshot());
+    CCoinsStats stats;
+    BOOST_REQUIRE(snapshot && snapshot->GetStats(stats));
+    BOOST_REQUIRE(stats.hashBlock == chainActive.Tip()->GetBlockHash());
+    CCoinsSetHash hashSet;
+    BOOST_REQUIRE(pblocktree->ReadUTXOCommitment(stats.hashBlock, hashSet));
+    BOOST_CHECK(hashSet == stats.hashSet);
+}
+
+BOOST_AUTO_TEST_CASE(utxocommitment_connect_disconnect)
+{
+    fUTXOCommitment = true;
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Blocks connected before the commitment was enabled have none
+    CBlockIndex* pindexEnabled = chainActive.Tip();
+    CCoinsSetHash hashSet;
+    BOOST_CHECK(!pblocktree->ReadUTXOCommitment(pindexEnabled->GetBlockHash(), hashSet));
+    BOOST_CHECK(InitUTXOCommitment());
+    CheckTipCommitment();
+
+    // A spend of a mature coinbase, with an unspendable output
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - COIN;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    tx.vout[1].nValue = 0;
+    tx.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, tx), scriptPubKey);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    CheckTipCommitment();
+
+    // Disconnecting blocks fills in the commitment of the block returned to
+    for (int i = 0; i < 2; i++) {
+        {
+            LOCK(cs_main);
+            CValidationState state;
+            BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+        }
+        CheckTipCommitment();
+    }
+    BOOST_CHECK(chainActive.Tip() == pindexEnabled->pprev);
+
+    fUTXOCommitment = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,64 +7,300 @@
 
 #include "chainparams.h"
 #include "hash.h"
+#include "init.h"
 #include "pow.h"
+#include "random.h"
 #include "uint256.h"
+#include "ui_interface.h"
+#include "util.h"
 
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
+static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 'p';
+static const char DB_UTXO_COMMITMENT = 'S';
 
+static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+namespace {
+
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << outpoint->hash;
+        s << VARINT(outpoint->n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> outpoint->hash;
+        s >> VARINT(outpoint->n);
+    }
+};
+
+}
+
+/** Fold the figures of a completed flush into the running totals. */
+static void AccumulateFlushStats(CCoinsFlushStats &stats, const CCoinsFlushStats &last, const uint256 &hashBlock)
 {
+    stats.nFlushes++;
+    stats.hashLastBlock = hashBlock;
+    stats.nLastWriteMicros = last.nLastWriteMicros;
+    stats.nLastBatches = last.nLastBatches;
+    stats.nLastCoins = last.nLastCoins;
+    stats.nLastBytes = last.nLastBytes;
+    stats.nTotalBytes += last.nLastBytes;
+    stats.nTotalWriteMicros += last.nLastWriteMicros;
 }
 
-bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(std::make_pair(DB_COINS, txid), coins);
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true),
+    fFlushPending(false), fFlushThread(false), fFlushStop(false), fFlushFailed(false)
+{
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(std::make_pair(DB_COINS, txid));
+CCoinsViewDB::~CCoinsViewDB()
+{
+    // Let the flush thread finish what it was handed, and make sure it no
+    // longer touches this object before it goes away.
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    fFlushStop = true;
+    condFlush.notify_all();
+    while (fFlushThread)
+        condFlush.wait(lock);
+}
+
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        if (!hashFlushing.IsNull()) {
+            CCoinsMap::const_iterator it = mapFlushing.find(outpoint);
+            if (it != mapFlushing.end()) {
+                if (it->second.coin.IsSpent())
+                    return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
+    return db.Read(CoinEntry(&outpoint), coin);
+}
+
+bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        if (!hashFlushing.IsNull()) {
+            CCoinsMap::const_iterator it = mapFlushing.find(outpoint);
+            if (it != mapFlushing.end())
+                return !it->second.coin.IsSpent();
+        }
+    }
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        if (!hashFlushing.IsNull())
+            return hashFlushing;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    std::vector<uint256> vhashHeadBlocks;
+    if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
+        return std::vector<uint256>();
+    }
+    return vhashHeadBlocks;
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase, CCoinsFlushStats &last) {
+    int64_t nStart = GetTimeMicros();
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
+    size_t batch_size = (size_t)GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    int crash_simulate = GetArg("-dbcrashratio", 0);
+
+    if (!hashBlock.IsNull()) {
+        // In the first batch, mark the database as being in the middle of a
+        // transition from old_tip to hashBlock.
+        uint256 old_tip;
+        if (!db.Read(DB_BEST_BLOCK, old_tip)) {
+            // We may be in the middle of replaying.
+            std::vector<uint256> old_heads = GetHeadBlocks();
+            if (old_heads.size() == 2) {
+                assert(old_heads[0] == hashBlock);
+                old_tip = old_heads[1];
+            }
+        }
+        batch.Erase(DB_BEST_BLOCK);
+        batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+    }
+
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(std::make_pair(DB_COINS, it->first));
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
             else
-                batch.Write(std::make_pair(DB_COINS, it->first), it->second.coins);
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            ++it;
+        }
+        if (batch.SizeEstimate() > batch_size) {
+            LogPrint("coindb", "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+            last.nLastBytes += batch.SizeEstimate();
+            last.nLastBatches++;
+            db.WriteBatch(batch);
+            batch.Clear();
+            if (crash_simulate && GetRand(crash_simulate) == 0) {
+                LogPrintf("Simulating a crash. Goodbye.\n");
+                _Exit(0);
+            }
+        }
     }
-    if (!hashBlock.IsNull())
+
+    // In the last batch, mark the database as consistent with hashBlock again.
+    if (!hashBlock.IsNull()) {
+        batch.Erase(DB_HEAD_BLOCKS);
         batch.Write(DB_BEST_BLOCK, hashBlock);
+    }
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    LogPrint("coindb", "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    last.nLastBytes += batch.SizeEstimate();
+    last.nLastBatches++;
+    bool ret = db.WriteBatch(batch);
+    last.nLastCoins = changed;
+    last.nLastWriteMicros = GetTimeMicros() - nStart;
+    LogPrint("coindb", "Committed %u changed transaction outputs (out of %u) to coin database in %.2fms\n", (unsigned int)changed, (unsigned int)count, last.nLastWriteMicros * 0.001);
+    return ret;
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    // Callers hold cs_main and cannot cope with being interrupted halfway.
+    boost::this_thread::disable_interruption di;
+    int64_t nStart = GetTimeMicros();
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    // Only one flush can be in flight; the next one waits for its predecessor.
+    while (fFlushPending)
+        condFlush.wait(lock);
+    if (fFlushFailed)
+        return false;
+
+    if (!fFlushThread || hashBlock.IsNull()) {
+        // Write synchronously. Readers wait on csFlush until the database is
+        // consistent again.
+        CCoinsFlushStats last;
+        if (!WriteCoins(mapCoins, hashBlock, true, last))
+            return false;
+        AccumulateFlushStats(flushStats, last, hashBlock);
+        flushStats.nLastStallMicros = GetTimeMicros() - nStart;
+        return true;
+    }
+
+    // Hand the entries over to the flush thread. The caller's map is left
+    // empty, exactly as after a synchronous write.
+    mapFlushing.swap(mapCoins);
+    hashFlushing = hashBlock;
+    fFlushPending = true;
+    flushStats.nLastStallMicros = GetTimeMicros() - nStart;
+    condFlush.notify_all();
+    return true;
+}
+
+bool CCoinsViewDB::ThreadFlush()
+{
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    fFlushThread = true;
+    flushStats.fBackground = true;
+    bool fOk = true;
+    try {
+        while (true) {
+            while (!fFlushPending && !fFlushStop)
+                condFlush.wait(lock);
+            if (!fFlushPending)
+                break;
+
+            // mapFlushing is not modified while a flush is pending, so it can
+            // be written without holding csFlush; readers only look into it.
+            lock.unlock();
+            CCoinsFlushStats last;
+            try {
+                fOk = WriteCoins(mapFlushing, hashFlushing, false, last);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                fOk = false;
+            }
+            lock.lock();
+
+            fFlushPending = false;
+            if (!fOk) {
+                // Keep serving reads from mapFlushing; the database is stale.
+                fFlushFailed = true;
+                break;
+            }
+            AccumulateFlushStats(flushStats, last, hashFlushing);
+            mapFlushing.clear();
+            hashFlushing.SetNull();
+            condFlush.notify_all();
+        }
+    } catch (const boost::thread_interrupted&) {
+        fFlushThread = false;
+        flushStats.fBackground = false;
+        condFlush.notify_all();
+        throw;
+    }
+    fFlushThread = false;
+    flushStats.fBackground = false;
+    condFlush.notify_all();
+    return fOk;
+}
+
+bool CCoinsViewDB::WaitForFlush() const
+{
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    while (fFlushPending)
+        condFlush.wait(lock);
+    return !fFlushFailed;
+}
+
+CCoinsFlushStats CCoinsViewDB::GetFlushStats() const
+{
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    CCoinsFlushStats stats = flushStats;
+    stats.fInProgress = fFlushPending;
+    return stats;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -92,33 +328,63 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // Iterate over a consistent database, not one being written to.
+    WaitForFlush();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
+    i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        i->pcursor->GetKey(i->keyTmp);
-    } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
-    }
+    i->CacheKey();
     return i;
 }
 
-bool CCoinsViewDBCursor::GetKey(uint256 &key) const
+CCoinsViewDBSnapshot *CCoinsViewDB::Snapshot() const
+{
+    // Hold csFlush so that no flush starts before the snapshot is taken.
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    while (fFlushPending)
+        condFlush.wait(lock);
+    uint256 hashBlock;
+    if (fFlushFailed || !db.Read(DB_BEST_BLOCK, hashBlock))
+        return NULL;
+    return new CCoinsViewDBSnapshot(db, hashBlock);
+}
+
+CCoinsViewDBSnapshot::CCoinsViewDBSnapshot(const CDBWrapper &dbIn, const uint256 &hashBlockIn) :
+    db(dbIn), snapshot(dbIn.GetSnapshot()), hashBlock(hashBlockIn)
+{
+}
+
+CCoinsViewDBSnapshot::~CCoinsViewDBSnapshot()
+{
+    db.ReleaseSnapshot(snapshot);
+}
+
+CCoinsViewCursor *CCoinsViewDBSnapshot::Cursor(unsigned int nBegin, unsigned int nEnd) const
+{
+    assert(nBegin < 256);
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(db.NewIterator(snapshot), hashBlock, nEnd);
+    i->pcursor->Seek(std::make_pair(DB_COIN, (unsigned char)nBegin));
+    i->CacheKey();
+    return i;
+}
+
+bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
+    if (keyTmp.first == DB_COIN) {
         key = keyTmp.second;
         return true;
     }
     return false;
 }
 
-bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
+bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coins);
+    return pcursor->GetValue(coin);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
@@ -128,14 +394,82 @@ unsigned int CCoinsViewDBCursor::GetValueSize() const
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return keyTmp.first == DB_COIN;
+}
+
+//! Calculate statistics about the coins a cursor goes over
+static bool GetStatsRange(CCoinsViewCursor *pcursor, CCoinsStats &stats)
+{
+    uint256 prevkey;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            return error("%s: unable to read value", __func__);
+        // A txid's outputs are next to each other, in a single range
+        if (stats.nTransactionOutputs == 0 || key.hash != prevkey)
+            stats.nTransactions++;
+        prevkey = key.hash;
+        stats.hashSet.Add(key, coin);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += coin.out.nValue;
+        stats.nSerializedSize += 32 + pcursor->GetValueSize();
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CCoinsViewDBSnapshot::GetStats(CCoinsStats &stats) const
+{
+    stats.hashBlock = hashBlock;
+
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_UTXO_STATS_THREADS));
+    std::vector<CCoinsStats> vStats(nThreads);
+    std::vector<char> vOk(nThreads, false);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.create_thread([this, &vStats, &vOk, nThreads, i] {
+            try {
+                std::unique_ptr<CCoinsViewCursor> pcursor(Cursor(256 * i / nThreads, 256 * (i + 1) / nThreads));
+                vOk[i] = GetStatsRange(pcursor.get(), vStats[i]);
+            } catch (const boost::thread_interrupted&) {
+            } catch (const std::exception& e) {
+                LogPrintf("CCoinsViewDBSnapshot::GetStats: %s\n", e.what());
+            }
+        });
+    }
+    try {
+        threads.join_all();
+    } catch (const boost::thread_interrupted&) {
+        boost::this_thread::disable_interruption di;
+        threads.interrupt_all();
+        threads.join_all();
+        throw;
+    }
+
+    for (int i = 0; i < nThreads; i++) {
+        if (!vOk[i])
+            return false;
+        stats.Combine(vStats[i]);
+    }
+    return true;
 }
 
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
+    CacheKey();
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry) || (entry.key == DB_COIN && *keyTmp.second.hash.begin() >= nEnd)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else {
+        keyTmp.first = entry.key;
+    }
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -150,17 +484,116 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+bool CBlockTreeDB::UpdateAddressIndex(const CAddressIndexUpdate &update, bool fConnect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=update.vHistory.begin(); it!=update.vHistory.end(); it++) {
+        if (fConnect)
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+        else
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    }
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=update.vUnspent.begin(); it!=update.vUnspent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+/** Erase all entries of an index whose keys are (prefix, Key), in batches. */
+template<typename Key>
+static bool EraseIndex(CDBWrapper &db, char prefix) {
+    size_t batch_size = (size_t)GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(prefix);
+    CDBBatch batch(db);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, Key> key;
+        if (!pcursor->GetKey(key) || key.first != prefix)
+            break;
+        batch.Erase(key);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    return db.WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseTxIndex() {
+    return EraseIndex<uint256>(*this, DB_TXINDEX);
+}
+
+bool CBlockTreeDB::EraseAddressIndex() {
+    return EraseIndex<CAddressIndexKey>(*this, DB_ADDRESSINDEX) &&
+           EraseIndex<CAddressUnspentKey>(*this, DB_ADDRESSUNSPENTINDEX);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const CAddressIndexKey &key, const std::function<bool(const CAddressIndexKey&, const CAddressIndexValue&)> &f) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, key));
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressIndexKey> keyEntry;
+        if (!pcursor->GetKey(keyEntry) || keyEntry.first != DB_ADDRESSINDEX || keyEntry.second.hashScript != key.hashScript)
+            break;
+        CAddressIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read value", __func__);
+        if (!f(keyEntry.second, value))
+            break;
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const CAddressUnspentKey &key, const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &f) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, key));
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressUnspentKey> keyEntry;
+        if (!pcursor->GetKey(keyEntry) || keyEntry.first != DB_ADDRESSUNSPENTINDEX || keyEntry.second.hashScript != key.hashScript)
+            break;
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read value", __func__);
+        if (!f(keyEntry.second, value))
+            break;
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    for (std::vector<std::pair<COutPoint, CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value) {
+    return Read(std::make_pair(DB_SPENTINDEX, outpoint), value);
+}
+
+bool CBlockTreeDB::EraseSpentIndex() {
+    return EraseIndex<COutPoint>(*this, DB_SPENTINDEX);
+}
+
+bool CBlockTreeDB::ReadUTXOCommitment(const uint256 &hashBlock, CCoinsSetHash &hashSet) {
+    return Read(std::make_pair(DB_UTXO_COMMITMENT, hashBlock), hashSet);
+}
+
+bool CBlockTreeDB::WriteUTXOCommitment(const uint256 &hashBlock, const CCoinsSetHash &hashSet) {
+    return Write(std::make_pair(DB_UTXO_COMMITMENT, hashBlock), hashSet);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -217,3 +650,126 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
 
     return true;
 }
+
+namespace {
+
+//! Legacy class to deserialize pre-per-output ("per transaction") UTXO records
+class CCoins
+{
+public:
+    //! whether transaction is a coinbase
+    bool fCoinBase;
+
+    //! unspent transaction outputs; spent outputs are .IsNull(); spent outputs at the end of the array are dropped
+    std::vector<CTxOut> vout;
+
+    //! at which height this transaction was included in the active block chain
+    int nHeight;
+
+    //! empty constructor
+    CCoins() : fCoinBase(false), vout(0), nHeight(0) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        // version
+        int nVersionDummy;
+        ::Unserialize(s, VARINT(nVersionDummy));
+        // header code
+        ::Unserialize(s, VARINT(nCode));
+        fCoinBase = nCode & 1;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 2) != 0;
+        vAvail[1] = (nCode & 4) != 0;
+        unsigned int nMaskCode = (nCode / 8) + ((nCode & 6) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])));
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight));
+    }
+};
+
+}
+
+/** Upgrade the database from older formats.
+ *
+ * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout.
+ */
+bool CCoinsViewDB::Upgrade() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+    if (!pcursor->Valid()) {
+        return true;
+    }
+
+    int64_t count = 0;
+    LogPrintf("Upgrading utxo-set database...\n");
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    std::pair<unsigned char, uint256> key;
+    std::pair<unsigned char, uint256> prev_key = std::make_pair(DB_COINS, uint256());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (pcursor->GetKey(key) && key.first == DB_COINS) {
+            if (count++ % 256 == 0) {
+                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+                uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone);
+                if (reportDone < percentageDone/10) {
+                    // report max. every 10% step
+                    LogPrintf("[%d%%]...", percentageDone);
+                    reportDone = percentageDone/10;
+                }
+            }
+            CCoins old_coins;
+            if (!pcursor->GetValue(old_coins)) {
+                return error("%s: cannot parse CCoins record", __func__);
+            }
+            COutPoint outpoint(key.second, 0);
+            for (size_t i = 0; i < old_coins.vout.size(); ++i) {
+                if (!old_coins.vout[i].IsNull() && !old_coins.vout[i].scriptPubKey.IsUnspendable()) {
+                    Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase);
+                    outpoint.n = i;
+                    CoinEntry entry(&outpoint);
+                    batch.Write(entry, newcoin);
+                }
+            }
+            batch.Erase(key);
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+                db.CompactRange(prev_key, key);
+                prev_key = key;
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    db.WriteBatch(batch);
+    db.CompactRange({DB_COINS, uint256()}, key);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
+}
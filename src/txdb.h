@@ -6,10 +6,14 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "spentindex.h"
+#include "sync.h"
 
+#include <functional>
 #include <map>
 #include <string>
 #include <utility>
@@ -19,6 +23,7 @@
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class CCoinsViewDBSnapshot;
 class uint256;
 
 //! Compensate for extra memory peak (x1.5-x1.9) at flush time.
@@ -33,14 +38,18 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache, if no -addressindex or -spentindex (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
-// Unlike for the UTXO database, for the txindex scenario the leveldb cache make
+//! Max memory allocated to block tree DB specific cache, if -addressindex or -spentindex (MiB)
+// Unlike for the UTXO database, for the index scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxBlockDBAndIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -dbbatchsize default (bytes)
+static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -chainstatebgflush default
+static const bool DEFAULT_CHAINSTATE_BACKGROUND_FLUSH = true;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -67,19 +76,85 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** Statistics about chainstate flushes, as reported by getchainstateflushinfo */
+struct CCoinsFlushStats
+{
+    //! Whether flushes are handed to the background flush thread
+    bool fBackground;
+    //! Whether a flush is currently being written
+    bool fInProgress;
+    //! Number of completed flushes
+    uint64_t nFlushes;
+    //! Block hash the last completed flush committed
+    uint256 hashLastBlock;
+    //! Time the caller was blocked by the last flush (microseconds)
+    int64_t nLastStallMicros;
+    //! Time spent writing the last flush to the database (microseconds)
+    int64_t nLastWriteMicros;
+    //! Number of database batches, changed coins and bytes of the last flush
+    uint64_t nLastBatches;
+    uint64_t nLastCoins;
+    uint64_t nLastBytes;
+    //! Totals over all completed flushes
+    uint64_t nTotalBytes;
+    int64_t nTotalWriteMicros;
+
+    CCoinsFlushStats() : fBackground(false), fInProgress(false), nFlushes(0), nLastStallMicros(0), nLastWriteMicros(0),
+                         nLastBatches(0), nLastCoins(0), nLastBytes(0), nTotalBytes(0), nTotalWriteMicros(0) {}
+};
+
+/** CCoinsView backed by the coin database (chainstate/)
+ *
+ * Writes are streamed to the database in -dbbatchsize chunks. While they are
+ * in progress the best block marker is replaced by a head marker naming the
+ * old and the new tip, so an interrupted flush can be completed at startup
+ * by ReplayBlocks().
+ *
+ * When ThreadFlush() is running, BatchWrite() only takes ownership of the
+ * dirty entries and returns; the flush thread writes them while reads are
+ * answered from the handed-over entries first.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+private:
+    mutable CWaitableCriticalSection csFlush;
+    mutable CConditionVariable condFlush;
+    //! Entries being written by the flush thread (protected by csFlush)
+    CCoinsMap mapFlushing;
+    //! Best block of mapFlushing; non-null while mapFlushing is live
+    uint256 hashFlushing;
+    bool fFlushPending;
+    bool fFlushThread;
+    bool fFlushStop;
+    bool fFlushFailed;
+    CCoinsFlushStats flushStats;
+
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase, CCoinsFlushStats &last);
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
+    std::vector<uint256> GetHeadBlocks() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+    //! Take a snapshot of the database once no flush is in progress. Returns NULL on failure.
+    CCoinsViewDBSnapshot *Snapshot() const;
+
+    //! Attempt to update from an older database format. Returns whether an error occurred.
+    bool Upgrade();
+
+    //! Write flushes handed over by BatchWrite until interrupted. Returns false if a write failed.
+    bool ThreadFlush();
+    //! Block until no flush is in progress. Returns false if the last flush failed.
+    bool WaitForFlush() const;
+    CCoinsFlushStats GetFlushStats() const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -88,18 +163,81 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     ~CCoinsViewDBCursor() {}
 
-    bool GetKey(uint256 &key) const;
-    bool GetValue(CCoins &coins) const;
+    bool GetKey(COutPoint &key) const;
+    bool GetValue(Coin &coin) const;
     unsigned int GetValueSize() const;
 
     bool Valid() const;
     void Next();
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, unsigned int nEndIn = 256):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), nEnd(nEndIn) {}
     std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    std::pair<char, COutPoint> keyTmp;
+    //! First txid byte past the range of the cursor, or 256 to go to the end
+    unsigned int nEnd;
+
+    //! Cache the key of the current record, or invalidate the cursor past its range
+    void CacheKey();
+
+    friend class CCoinsViewDB;
+    friend class CCoinsViewDBSnapshot;
+};
+
+//! Maximum number of threads the statistics of the UTXO set are computed by
+static const int MAX_UTXO_STATS_THREADS = 16;
+
+/** Statistics about the UTXO set, or a part of it */
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CCoinsSetHash hashSet;
+    arith_uint256 nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    //! Add the statistics of a disjoint part of the set
+    void Combine(const CCoinsStats &other)
+    {
+        nTransactions += other.nTransactions;
+        nTransactionOutputs += other.nTransactionOutputs;
+        nSerializedSize += other.nSerializedSize;
+        hashSet.Combine(other.hashSet);
+        nTotalAmount += other.nTotalAmount;
+    }
+};
+
+/**
+ * A read-only view of the coin database as of a consistent state, which
+ * flushes written after it was taken don't change. Cursors must be
+ * destroyed before the snapshot.
+ */
+class CCoinsViewDBSnapshot
+{
+public:
+    ~CCoinsViewDBSnapshot();
+
+    const uint256 &GetBestBlock() const { return hashBlock; }
+
+    //! Get a cursor over the coins whose txid starts with a byte in [nBegin, nEnd)
+    CCoinsViewCursor *Cursor(unsigned int nBegin = 0, unsigned int nEnd = 256) const;
+
+    //! Calculate the statistics of the set, split among threads by the first byte of the txids. Doesn't set nHeight.
+    bool GetStats(CCoinsStats &stats) const;
+
+private:
+    CCoinsViewDBSnapshot(const CDBWrapper &dbIn, const uint256 &hashBlockIn);
+    CCoinsViewDBSnapshot(const CCoinsViewDBSnapshot&);
+    void operator=(const CCoinsViewDBSnapshot&);
+
+    const CDBWrapper &db;
+    const leveldb::Snapshot *snapshot;
+    uint256 hashBlock;
 
     friend class CCoinsViewDB;
 };
@@ -118,8 +256,21 @@ public:
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    /** Erase the transaction index older versions kept in this database. */
+    bool EraseTxIndex();
+    bool UpdateAddressIndex(const CAddressIndexUpdate &update, bool fConnect);
+    bool EraseAddressIndex();
+    /** Call f for the history of key.hashScript from key on, until f returns false. */
+    bool ReadAddressIndex(const CAddressIndexKey &key, const std::function<bool(const CAddressIndexKey&, const CAddressIndexValue&)> &f);
+    /** Call f for the unspent outputs of key.hashScript from key on, until f returns false. */
+    bool ReadAddressUnspentIndex(const CAddressUnspentKey &key, const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &f);
+    /** Write the spending inputs of outpoints, or erase those whose value is null. */
+    bool UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> > &vect);
+    bool ReadSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value);
+    bool EraseSpentIndex();
+    /** The hash of the UTXO set as of a block, kept per block hash as it depends on nothing else. */
+    bool ReadUTXOCommitment(const uint256 &hashBlock, CCoinsSetHash &hashSet);
+    bool WriteUTXOCommitment(const uint256 &hashBlock, const CCoinsSetHash &hashSet);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
@@ -0,0 +1,174 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+static const char DB_TXINDEX = 't';
+static const char DB_BEST_BLOCK = 'B';
+
+//! Longest the index collects transactions before writing them (microseconds)
+static const int64_t TXINDEX_BATCH_INTERVAL = 30 * 1000000;
+
+std::unique_ptr<CTxIndex> g_txindex;
+
+static boost::filesystem::path GetTxIndexDir()
+{
+    boost::filesystem::path path = GetDataDir() / "indexes";
+    TryCreateDirectory(path);
+    return path / "txindex";
+}
+
+CTxIndexDB::CTxIndexDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetTxIndexDir(), nCacheSize, fMemory, fWipe) {
+}
+
+bool CTxIndexDB::ReadTxPos(const uint256 &txid, CDiskTxPos &pos) const {
+    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+}
+
+bool CTxIndexDB::ReadBestBlock(CBlockLocator &locator) const {
+    return Read(DB_BEST_BLOCK, locator);
+}
+
+bool CTxIndexDB::WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos> > &vPos, const CBlockLocator &locator) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it=vPos.begin(); it!=vPos.end(); it++)
+        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    batch.Write(DB_BEST_BLOCK, locator);
+    return WriteBatch(batch);
+}
+
+CTxIndex::CTxIndex(size_t nCacheSize, bool fMemory, bool fWipe) :
+    db(new CTxIndexDB(nCacheSize, fMemory, fWipe)), pindexBest(NULL), fSynced(false), fWake(false)
+{
+}
+
+bool CTxIndex::Init()
+{
+    CBlockLocator locator;
+    if (!db->ReadBestBlock(locator))
+        locator.SetNull();
+
+    LOCK(cs_main);
+    pindexBest = locator.IsNull() ? NULL : FindForkInGlobalIndex(chainActive, locator);
+    LogPrintf("%s: transaction index %s\n", __func__, pindexBest ? strprintf("at height %d", pindexBest->nHeight) : "empty");
+    return true;
+}
+
+const CBlockIndex* CTxIndex::GetBestBlock() const
+{
+    LOCK(cs_main);
+    return pindexBest;
+}
+
+bool CTxIndex::FindTx(const uint256& txid, CDiskTxPos& pos) const
+{
+    return db->ReadTxPos(txid, pos);
+}
+
+void CTxIndex::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    boost::unique_lock<boost::mutex> lock(csWake);
+    fWake = true;
+    condWake.notify_one();
+}
+
+bool CTxIndex::WriteBatch(std::vector<std::pair<uint256, CDiskTxPos> >& vPos, const CBlockIndex* pindex)
+{
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindex);
+    }
+    if (!db->WriteTxs(vPos, locator))
+        return error("%s: failed to write transaction index", __func__);
+    vPos.clear();
+    LOCK(cs_main);
+    pindexBest = pindex;
+    return true;
+}
+
+bool CTxIndex::Sync()
+{
+    const CChainParams& chainparams = Params();
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    const CBlockIndex* pindex = GetBestBlock();
+    int64_t nLastWrite = GetTimeMicros();
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindexNext;
+        CDiskBlockPos blockPos;
+        {
+            LOCK(cs_main);
+            // Go on from the fork point after a reorganization. Whatever is
+            // collected of the disconnected blocks is written all the same,
+            // as their block data stays on disk.
+            if (pindex && !chainActive.Contains(pindex))
+                pindex = chainActive.FindFork(pindex);
+            pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+            if (pindexNext)
+                blockPos = pindexNext->GetBlockPos();
+        }
+        if (!pindexNext)
+            break;
+
+        // The genesis coinbase can't be spent, and was never indexed
+        if (pindexNext->nHeight > 0) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, blockPos, chainparams.GetConsensus(pindexNext->nHeight), false) ||
+                block.GetHash() != pindexNext->GetBlockHash())
+                return error("%s: failed to read block %s", __func__, pindexNext->GetBlockHash().ToString());
+            CDiskTxPos pos(blockPos, GetSizeOfCompactSize(block.vtx.size()));
+            for (const CTransactionRef& tx : block.vtx) {
+                vPos.push_back(std::make_pair(tx->GetHash(), pos));
+                pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+            }
+        }
+        pindex = pindexNext;
+
+        if (vPos.size() >= TXINDEX_BATCH_TXS || GetTimeMicros() - nLastWrite > TXINDEX_BATCH_INTERVAL) {
+            if (!WriteBatch(vPos, pindex))
+                return false;
+            nLastWrite = GetTimeMicros();
+            if (!fSynced)
+                LogPrintf("%s: transaction index at height %d\n", __func__, pindex->nHeight);
+        }
+    }
+
+    if (pindex && pindex != GetBestBlock() && !WriteBatch(vPos, pindex))
+        return false;
+    if (!fSynced && pindex) {
+        LogPrintf("%s: transaction index synced to height %d\n", __func__, pindex->nHeight);
+        fSynced = true;
+    }
+    return true;
+}
+
+bool CTxIndex::ThreadSync()
+{
+    // Drop the index the block tree database used to keep
+    bool fLegacyIndex = false;
+    if (pblocktree->ReadFlag("txindex", fLegacyIndex) && fLegacyIndex) {
+        LogPrintf("%s: removing the transaction index from the block index database\n", __func__);
+        if (!pblocktree->EraseTxIndex() || !pblocktree->WriteFlag("txindex", false))
+            return error("%s: failed to remove the old transaction index", __func__);
+    }
+
+    while (true) {
+        if (!Sync())
+            return false;
+        boost::unique_lock<boost::mutex> lock(csWake);
+        while (!fWake)
+            condWake.wait(lock);
+        fWake = false;
+    }
+}
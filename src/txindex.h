@@ -0,0 +1,94 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINDEX_H
+#define BITCOIN_TXINDEX_H
+
+#include "dbwrapper.h"
+#include "sync.h"
+#include "txdb.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+struct CBlockLocator;
+
+//! Max memory allocated to the transaction index database cache (MiB)
+static const int64_t nMaxTxIndexCache = 1024;
+//! Number of transactions the transaction index collects before writing them
+static const size_t TXINDEX_BATCH_TXS = 100000;
+
+/** Access to the transaction index database (indexes/txindex/) */
+class CTxIndexDB : public CDBWrapper
+{
+public:
+    CTxIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CTxIndexDB(const CTxIndexDB&);
+    void operator=(const CTxIndexDB&);
+public:
+    bool ReadTxPos(const uint256 &txid, CDiskTxPos &pos) const;
+    bool ReadBestBlock(CBlockLocator &locator) const;
+    /** Write the positions of transactions together with the block the index then reaches. */
+    bool WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos> > &vPos, const CBlockLocator &locator);
+};
+
+/**
+ * Transaction index, kept in its own database and built in the background.
+ *
+ * Block connection doesn't wait for the index. Instead, the index thread is
+ * woken whenever the tip changes, reads the blocks it is missing from the
+ * block files and writes their transactions in batches, together with a
+ * locator of the last block written. It thus catches up with the chain after
+ * it is enabled, without a reindex, and resumes where it left off after a
+ * restart. Transactions of blocks that are disconnected stay in the index,
+ * as their block data stays on disk.
+ */
+class CTxIndex : public CValidationInterface
+{
+private:
+    std::unique_ptr<CTxIndexDB> db;
+
+    //! Last block whose transactions are written, protected by cs_main
+    const CBlockIndex* pindexBest;
+    std::atomic<bool> fSynced;
+
+    CWaitableCriticalSection csWake;
+    CConditionVariable condWake;
+    bool fWake;
+
+    bool WriteBatch(std::vector<std::pair<uint256, CDiskTxPos> >& vPos, const CBlockIndex* pindex);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+public:
+    CTxIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Find where the index left off. Requires the block index to be loaded. */
+    bool Init();
+
+    /** Index the blocks of the active chain the index is missing. */
+    bool Sync();
+
+    /** Sync whenever the tip changes, until interrupted. Returns false on failure. */
+    bool ThreadSync();
+
+    /** Look up the position of a transaction in the block files. */
+    bool FindTx(const uint256& txid, CDiskTxPos& pos) const;
+
+    /** Whether the index caught up with the active chain since startup. */
+    bool IsSynced() const { return fSynced; }
+
+    const CBlockIndex* GetBestBlock() const;
+};
+
+/** The transaction index, if -txindex is set */
+extern std::unique_ptr<CTxIndex> g_txindex;
+
+#endif // BITCOIN_TXINDEX_H
@@ -38,6 +38,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     assert(inChainInputValue <= nValueIn);
 
     feeDelta = 0;
+    nEpoch = 0;
 
     nCountWithAncestors = 1;
     nSizeWithAncestors = GetTxSize();
@@ -45,9 +46,19 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSigOpCostWithAncestors = sigOpCost;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
+// The links point into the mempool holding other, which sets up its own.
+CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other) :
+    tx(other.tx), nFee(other.nFee), nTxWeight(other.nTxWeight), nModSize(other.nModSize),
+    nUsageSize(other.nUsageSize), nTime(other.nTime), entryPriority(other.entryPriority),
+    entryHeight(other.entryHeight), inChainInputValue(other.inChainInputValue),
+    spendsCoinbase(other.spendsCoinbase), sigOpCost(other.sigOpCost), feeDelta(other.feeDelta),
+    lockPoints(other.lockPoints),
+    nCountWithDescendants(other.nCountWithDescendants), nSizeWithDescendants(other.nSizeWithDescendants),
+    nModFeesWithDescendants(other.nModFeesWithDescendants),
+    nCountWithAncestors(other.nCountWithAncestors), nSizeWithAncestors(other.nSizeWithAncestors),
+    nModFeesWithAncestors(other.nModFeesWithAncestors), nSigOpCostWithAncestors(other.nSigOpCostWithAncestors),
+    vTxHashesIdx(other.vTxHashesIdx), nEpoch(other.nEpoch)
 {
-    *this = other;
 }
 
 double
@@ -82,43 +93,58 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
-
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        BOOST_FOREACH(const txiter childEntry, setChildren) {
+    EpochGuard epoch(*this);
+    std::vector<txiter> vStage, vAllDescendants;
+    BOOST_FOREACH(const CTxMemPoolEntry& child, GetMemPoolChildren(updateIt)) {
+        const txiter childEntry = mapTx.iterator_to(child);
+        if (!visited(childEntry)) {
+            vStage.push_back(childEntry);
+        }
+    }
+
+    while (!vStage.empty()) {
+        const txiter cit = vStage.back();
+        vStage.pop_back();
+        vAllDescendants.push_back(cit);
+        BOOST_FOREACH(const CTxMemPoolEntry& child, GetMemPoolChildren(cit)) {
+            const txiter childEntry = mapTx.iterator_to(child);
+            if (visited(childEntry)) {
+                continue;
+            }
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
+                // but don't traverse again. (The child itself is in setExclude.)
                 BOOST_FOREACH(const txiter cacheEntry, cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!visited(cacheEntry)) {
+                        vAllDescendants.push_back(cacheEntry);
+                    }
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                vStage.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
-    // Update and add to cached descendant map
+    // vAllDescendants now contains all in-mempool descendants of updateIt,
+    // each once. Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    BOOST_FOREACH(txiter cit, setAllDescendants) {
+    std::vector<txiter> vDescendantsToCache;
+    BOOST_FOREACH(txiter cit, vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            vDescendantsToCache.push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
     }
+    if (!vDescendantsToCache.empty()) {
+        cachedDescendants[updateIt] = std::move(vDescendantsToCache);
+    }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
 }
 
@@ -168,13 +194,18 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+    // The links and descendant state of the entries changed
+    ++nTransactionsUpdated;
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
     LOCK(cs);
 
-    setEntries parentHashes;
+    // Ancestors go into setAncestors as soon as they are found, so it doubles
+    // as the set of entries that were seen; vStage holds the ones whose
+    // parents haven't been looked at yet.
+    std::vector<txiter> vStage;
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -183,9 +214,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
-                if (parentHashes.size() + 1 > limitAncestorCount) {
+            if (piter != mapTx.end() && setAncestors.insert(piter).second) {
+                vStage.push_back(piter);
+                if (setAncestors.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
                 }
@@ -194,17 +225,19 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     } else {
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
-        txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        BOOST_FOREACH(const CTxMemPoolEntry& parent, entry.GetMemPoolParentsConst()) {
+            const txiter piter = mapTx.iterator_to(parent);
+            if (setAncestors.insert(piter).second) {
+                vStage.push_back(piter);
+            }
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
-
-        setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+    while (!vStage.empty()) {
+        txiter stageit = vStage.back();
+        vStage.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -218,13 +251,13 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
-        BOOST_FOREACH(const txiter &phash, setMemPoolParents) {
+        BOOST_FOREACH(const CTxMemPoolEntry& parent, stageit->GetMemPoolParentsConst()) {
+            const txiter phash = mapTx.iterator_to(parent);
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (setAncestors.insert(phash).second) {
+                vStage.push_back(phash);
             }
-            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+            if (setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
                 return false;
             }
@@ -236,10 +269,10 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
+    const CTxMemPoolEntry::Parents& parents = it->GetMemPoolParentsConst();
     // add or remove this tx as a child of each parent
-    BOOST_FOREACH(txiter piter, parentIters) {
-        UpdateChild(piter, it, add);
+    BOOST_FOREACH(const CTxMemPoolEntry& parent, parents) {
+        UpdateChild(mapTx.iterator_to(parent), it, add);
     }
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
@@ -265,9 +298,9 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-    BOOST_FOREACH(txiter updateIt, setMemPoolChildren) {
-        UpdateParent(updateIt, it, false);
+    const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
+    BOOST_FOREACH(const CTxMemPoolEntry& updateIt, children) {
+        UpdateParent(mapTx.iterator_to(updateIt), it, false);
     }
 }
 
@@ -280,7 +313,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block.
-        // Here we only update statistics and not data in mapLinks (which
+        // Here we only update statistics and not the parent/child links (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
         BOOST_FOREACH(txiter removeIt, entriesToRemove) {
@@ -305,16 +338,16 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // should be a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of 
+        // of ancestors reachable via the links will be the same as the set of 
         // ancestors whose packages include this transaction, because when we
         // add a new transaction to the mempool in addUnchecked(), we assume it
         // has no children, and in the case of a reorg where that assumption is
         // false, the in-mempool children aren't linked to the in-block tx's
         // until UpdateTransactionsFromBlock() is called.
         // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
+        // UpdateTransactionsFromBlock() has been called, then the links will
         // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
+        // and it's important that we use the links' notion of ancestor
         // transactions as the set of things to update for removal.
         CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
         // Note that UpdateAncestorsOf severs the child links that point to
@@ -350,7 +383,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), nEpoch(0), fHasEpochGuard(false), mapTx(indexed_transaction_set::ctor_args_list(), entry_allocator(&poolResource))
 {
     _clear(); //lock free clear
 
@@ -360,6 +393,8 @@ CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
     nCheckFrequency = 0;
 
     minerPolicyEstimator = new CBlockPolicyEstimator(_minReasonableRelayFee);
+
+    nPoolOverhead = poolResource.PooledMemoryUsage();
 }
 
 CTxMemPool::~CTxMemPool()
@@ -367,17 +402,10 @@ CTxMemPool::~CTxMemPool()
     delete minerPolicyEstimator;
 }
 
-void CTxMemPool::pruneSpent(const uint256 &hashTx, CCoins &coins)
+bool CTxMemPool::isSpent(const COutPoint& outpoint)
 {
     LOCK(cs);
-
-    auto it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
-
-    // iterate over all COutPoints in mapNextTx whose hash equals the provided hashTx
-    while (it != mapNextTx.end() && it->first->hash == hashTx) {
-        coins.Spend(it->first->n); // and remove those outputs from coins
-        it++;
-    }
+    return mapNextTx.count(outpoint);
 }
 
 unsigned int CTxMemPool::GetTransactionsUpdated() const
@@ -400,7 +428,10 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    // The entry was copied without its links; give it link sets that
+    // allocate from the pool.
+    newit->GetMemPoolParents() = CTxMemPoolEntry::Parents(CompareIteratorByHash(), CPoolAllocator<CTxMemPoolEntry::CTxMemPoolEntryRef>(&poolResource));
+    newit->GetMemPoolChildren() = CTxMemPoolEntry::Children(CompareIteratorByHash(), CPoolAllocator<CTxMemPoolEntry::CTxMemPoolEntryRef>(&poolResource));
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -414,8 +445,6 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     }
 
     // Update cachedInnerUsage to include contained transaction's usage.
-    // (When we update the entry for in-mempool parents, memory usage will be
-    // further updated.)
     cachedInnerUsage += entry.DynamicMemoryUsage();
 
     const CTransaction& tx = newit->GetTx();
@@ -469,8 +498,6 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(hash);
@@ -484,22 +511,21 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+    std::vector<txiter> vStage;
+    if (setDescendants.insert(entryit).second) {
+        vStage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
-    while (!stage.empty()) {
-        txiter it = *stage.begin();
-        setDescendants.insert(it);
-        stage.erase(it);
-
-        const setEntries &setChildren = GetMemPoolChildren(it);
-        BOOST_FOREACH(const txiter &childiter, setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+    while (!vStage.empty()) {
+        txiter it = vStage.back();
+        vStage.pop_back();
+
+        BOOST_FOREACH(const CTxMemPoolEntry& child, it->GetMemPoolChildrenConst()) {
+            const txiter childiter = mapTx.iterator_to(child);
+            if (setDescendants.insert(childiter).second) {
+                vStage.push_back(childiter);
             }
         }
     }
@@ -555,10 +581,10 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
                 indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
                 if (it2 != mapTx.end())
                     continue;
-                const CCoins *coins = pcoins->AccessCoins(txin.prevout.hash);
-                if (nCheckFrequency != 0) assert(coins);
-                int nCoinbaseMaturity = Params().GetConsensus(coins->nHeight).nCoinbaseMaturity;
-                if (!coins || (coins->IsCoinBase() && ((signed long)nMemPoolHeight) - coins->nHeight < nCoinbaseMaturity)) {
+                const Coin &coin = pcoins->AccessCoin(txin.prevout);
+                if (nCheckFrequency != 0) assert(!coin.IsSpent());
+                int nCoinbaseMaturity = Params().GetConsensus(coin.nHeight).nCoinbaseMaturity;
+                if (coin.IsSpent() || (coin.IsCoinBase() && ((signed long)nMemPoolHeight) - coin.nHeight < nCoinbaseMaturity)) {
                     txToRemove.insert(it);
                     break;
                 }
@@ -626,7 +652,6 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -660,6 +685,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     const int64_t nSpendHeight = GetSpendHeight(mempoolDuplicate);
     const CChainParams& params = Params();
 
+    // Link sets are equal if they refer to the very same entries
+    auto comp = [](const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) { return &a == &b; };
+
     LOCK(cs);
     std::list<const CTxMemPoolEntry*> waitingOnDependants;
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
@@ -667,12 +695,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
-        setEntries setParentCheck;
+        CTxMemPoolEntry::Parents setParentCheck;
         int64_t parentSizes = 0;
         int64_t parentSigOpCost = 0;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
@@ -682,13 +706,12 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
-                if (setParentCheck.insert(it2).second) {
+                if (setParentCheck.insert(*it2).second) {
                     parentSizes += it2->GetTxSize();
                     parentSigOpCost += it2->GetSigOpCost();
                 }
             } else {
-                const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-                assert(coins && coins->IsAvailable(txin.prevout.n));
+                assert(pcoins->HaveCoin(txin.prevout));
             }
             // Check whether its inputs are marked in mapNextTx.
             auto it3 = mapNextTx.find(txin.prevout);
@@ -697,7 +720,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(setParentCheck.size() == it->GetMemPoolParentsConst().size());
+        assert(std::equal(setParentCheck.begin(), setParentCheck.end(), it->GetMemPoolParentsConst().begin(), comp));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -720,17 +744,18 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(it->GetModFeesWithAncestors() == nFeesCheck);
 
         // Check children against mapNextTx
-        CTxMemPool::setEntries setChildrenCheck;
+        CTxMemPoolEntry::Children setChildrenCheck;
         auto iter = mapNextTx.lower_bound(COutPoint(it->GetTx().GetHash(), 0));
         int64_t childSizes = 0;
         for (; iter != mapNextTx.end() && iter->first->hash == it->GetTx().GetHash(); ++iter) {
             txiter childit = mapTx.find(iter->second->GetHash());
             assert(childit != mapTx.end()); // mapNextTx points to in-mempool transactions
-            if (setChildrenCheck.insert(childit).second) {
+            if (setChildrenCheck.insert(*childit).second) {
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(setChildrenCheck.size() == it->GetMemPoolChildrenConst().size());
+        assert(std::equal(setChildrenCheck.begin(), setChildrenCheck.end(), it->GetMemPoolChildrenConst().begin(), comp));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
@@ -793,58 +818,100 @@ namespace {
 class DepthAndScoreComparator
 {
 public:
-    bool operator()(const CTxMemPool::indexed_transaction_set::const_iterator& a, const CTxMemPool::indexed_transaction_set::const_iterator& b)
+    DepthAndScoreComparator(const std::vector<CTxMemPoolSnapshot::Entry>& vEntriesIn) : vEntries(vEntriesIn) {}
+
+    bool operator()(uint32_t a, uint32_t b) const
     {
-        uint64_t counta = a->GetCountWithAncestors();
-        uint64_t countb = b->GetCountWithAncestors();
+        const CTxMemPoolEntry& entrya = vEntries[a].entry;
+        const CTxMemPoolEntry& entryb = vEntries[b].entry;
+        uint64_t counta = entrya.GetCountWithAncestors();
+        uint64_t countb = entryb.GetCountWithAncestors();
         if (counta == countb) {
-            return CompareTxMemPoolEntryByScore()(*a, *b);
+            return CompareTxMemPoolEntryByScore()(entrya, entryb);
         }
         return counta < countb;
     }
+
+private:
+    const std::vector<CTxMemPoolSnapshot::Entry>& vEntries;
 };
 }
 
-std::vector<CTxMemPool::indexed_transaction_set::const_iterator> CTxMemPool::GetSortedDepthAndScore() const
+CTxMemPoolSnapshot::Entry::Entry(const CTxMemPoolEntry& e) : entry(e)
 {
-    std::vector<indexed_transaction_set::const_iterator> iters;
-    AssertLockHeld(cs);
+    vParents.reserve(e.GetMemPoolParentsConst().size());
+    BOOST_FOREACH(const CTxMemPoolEntry& parent, e.GetMemPoolParentsConst())
+        vParents.push_back(parent.GetTx().GetHash());
+}
 
-    iters.reserve(mapTx.size());
+void CTxMemPoolSnapshot::SortDepthAndScore()
+{
+    vSortedDepthAndScore.resize(vEntries.size());
+    for (uint32_t i = 0; i < vSortedDepthAndScore.size(); i++)
+        vSortedDepthAndScore[i] = i;
+    std::sort(vSortedDepthAndScore.begin(), vSortedDepthAndScore.end(), DepthAndScoreComparator(vEntries));
+}
 
-    for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi) {
-        iters.push_back(mi);
+std::shared_ptr<const CTxMemPoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    {
+        LOCK(cs_snapshot);
+        if (snapshot && snapshot->nTransactionsUpdated == nTransactionsUpdated)
+            return snapshot;
+    }
+
+    LOCK(cs_snapshotbuild);
+    {
+        // Another reader may have taken one in the meantime
+        LOCK(cs_snapshot);
+        if (snapshot && snapshot->nTransactionsUpdated == nTransactionsUpdated)
+            return snapshot;
     }
-    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
-    return iters;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::shared_ptr<CTxMemPoolSnapshot> newsnapshot;
+    {
+        LOCK(cs);
+        newsnapshot = std::make_shared<CTxMemPoolSnapshot>(nTransactionsUpdated);
+        newsnapshot->vEntries.reserve(mapTx.size());
+        BOOST_FOREACH(const CTxMemPoolEntry& e, mapTx)
+            newsnapshot->vEntries.emplace_back(e);
+    }
+    int64_t nTimeLocked = GetTimeMicros();
+    newsnapshot->SortDepthAndScore();
+    int64_t nTimeSorted = GetTimeMicros();
+    LogPrint("bench", "Mempool snapshot of %u transactions: %.2fms holding mempool.cs, %.2fms sorting\n",
+             newsnapshot->vEntries.size(), 0.001 * (nTimeLocked - nTimeStart), 0.001 * (nTimeSorted - nTimeLocked));
+
+    LOCK(cs_snapshot);
+    snapshot = newsnapshot;
+    return snapshot;
 }
 
 void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 {
-    LOCK(cs);
-    auto iters = GetSortedDepthAndScore();
+    std::shared_ptr<const CTxMemPoolSnapshot> current = GetSnapshot();
 
     vtxid.clear();
-    vtxid.reserve(mapTx.size());
+    vtxid.reserve(current->vEntries.size());
 
-    for (auto it : iters) {
-        vtxid.push_back(it->GetTx().GetHash());
+    for (uint32_t i : current->vSortedDepthAndScore) {
+        vtxid.push_back(current->vEntries[i].GetTxid());
     }
 }
 
-static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
-    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee()};
+static TxMempoolInfo GetInfo(const CTxMemPoolEntry& entry) {
+    return TxMempoolInfo{entry.GetSharedTx(), entry.GetTime(), CFeeRate(entry.GetFee(), entry.GetTxSize()), entry.GetModifiedFee() - entry.GetFee()};
 }
 
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
 {
-    LOCK(cs);
-    auto iters = GetSortedDepthAndScore();
+    std::shared_ptr<const CTxMemPoolSnapshot> current = GetSnapshot();
 
     std::vector<TxMempoolInfo> ret;
-    ret.reserve(mapTx.size());
-    for (auto it : iters) {
-        ret.push_back(GetInfo(it));
+    ret.reserve(current->vEntries.size());
+    for (uint32_t i : current->vSortedDepthAndScore) {
+        ret.push_back(GetInfo(current->vEntries[i].entry));
     }
 
     return ret;
@@ -865,7 +932,7 @@ TxMempoolInfo CTxMemPool::info(const uint256& hash) const
     indexed_transaction_set::const_iterator i = mapTx.find(hash);
     if (i == mapTx.end())
         return TxMempoolInfo();
-    return GetInfo(i);
+    return GetInfo(*i);
 }
 
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
@@ -981,26 +1048,33 @@ bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) { }
 
-bool CCoinsViewMemPool::GetCoins(const uint256 &txid, CCoins &coins) const {
+bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
-    CTransactionRef ptx = mempool.get(txid);
+    CTransactionRef ptx = mempool.get(outpoint.hash);
     if (ptx) {
-        coins = CCoins(*ptx, MEMPOOL_HEIGHT);
-        return true;
+        if (outpoint.n < ptx->vout.size()) {
+            coin = Coin(ptx->vout[outpoint.n], MEMPOOL_HEIGHT, false);
+            return true;
+        } else {
+            return false;
+        }
     }
-    return (base->GetCoins(txid, coins) && !coins.IsPruned());
+    return (base->GetCoin(outpoint, coin) && !coin.IsSpent());
 }
 
-bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
-    return mempool.exists(txid) || base->HaveCoins(txid);
+bool CCoinsViewMemPool::HaveCoin(const COutPoint &outpoint) const {
+    return mempool.exists(outpoint) || base->HaveCoin(outpoint);
 }
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // The nodes of mapTx and the entries' parent/child sets are allocated
+    // from poolResource, which counts exactly what it hands out. Like before,
+    // the fixed overhead of mapTx and the bucket array of its txid index are
+    // left out.
+    return poolResource.PooledMemoryUsage() - nPoolOverhead + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -1039,38 +1113,44 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
 
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    if (add) {
+        entry->GetMemPoolChildren().insert(*child);
+    } else {
+        entry->GetMemPoolChildren().erase(*child);
     }
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    if (add) {
+        entry->GetMemPoolParents().insert(*parent);
+    } else {
+        entry->GetMemPoolParents().erase(*parent);
     }
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPoolEntry::Parents & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    return entry->GetMemPoolParentsConst();
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPoolEntry::Children & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    return entry->GetMemPoolChildrenConst();
+}
+
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool& in) : pool(in)
+{
+    assert(!pool.fHasEpochGuard);
+    ++pool.nEpoch;
+    pool.fHasEpochGuard = true;
+}
+
+CTxMemPool::EpochGuard::~EpochGuard()
+{
+    pool.fHasEpochGuard = false;
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -1105,7 +1185,7 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining) {
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining) {
     LOCK(cs);
 
     unsigned nTxnRemoved = 0;
@@ -1138,9 +1218,8 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRe
                 BOOST_FOREACH(const CTxIn& txin, tx.vin) {
                     if (exists(txin.prevout.hash))
                         continue;
-                    auto iter = mapNextTx.lower_bound(COutPoint(txin.prevout.hash, 0));
-                    if (iter == mapNextTx.end() || iter->first->hash != txin.prevout.hash)
-                        pvNoSpendsRemaining->push_back(txin.prevout.hash);
+                    if (!mapNextTx.count(txin.prevout))
+                        pvNoSpendsRemaining->push_back(txin.prevout);
                 }
             }
         }
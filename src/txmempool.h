@@ -6,6 +6,8 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <set>
 #include <map>
@@ -19,6 +21,7 @@
 #include "primitives/transaction.h"
 #include "sync.h"
 #include "random.h"
+#include "support/allocators/pool.h"
 
 #undef foreach
 #include "boost/multi_index_container.hpp"
@@ -42,7 +45,7 @@ inline bool AllowFree(double dPriority)
     return dPriority > AllowFreeThreshold();
 }
 
-/** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
+/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
 struct LockPoints
@@ -62,6 +65,20 @@ struct LockPoints
 
 class CTxMemPool;
 
+/** Orders mempool entries, referred to by iterator or by reference, by txid */
+struct CompareIteratorByHash {
+    template <typename T>
+    bool operator()(const std::reference_wrapper<T>& a, const std::reference_wrapper<T>& b) const
+    {
+        return a.get().GetTx().GetHash() < b.get().GetTx().GetHash();
+    }
+    template <typename T>
+    bool operator()(const T& a, const T& b) const
+    {
+        return a->GetTx().GetHash() < b->GetTx().GetHash();
+    }
+};
+
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the corresponding transaction, as well
@@ -77,10 +94,17 @@ class CTxMemPool;
  * nFee+feeDelta. (This can potentially happen during a reorg, where we limit the
  * amount of work we're willing to do to avoid consuming too much CPU.)
  *
+ * The entry also links to its direct in-mempool parents and children, so
+ * walking the mempool graph doesn't need a lookup per step.
  */
 
 class CTxMemPoolEntry
 {
+public:
+    typedef std::reference_wrapper<const CTxMemPoolEntry> CTxMemPoolEntryRef;
+    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash, CPoolAllocator<CTxMemPoolEntryRef> > Parents;
+    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash, CPoolAllocator<CTxMemPoolEntryRef> > Children;
+
 private:
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
@@ -111,6 +135,10 @@ private:
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    // Direct in-mempool parents and children, maintained by CTxMemPool
+    mutable Parents setMemPoolParents;
+    mutable Children setMemPoolChildren;
+
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
@@ -157,7 +185,13 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
+    const Parents& GetMemPoolParentsConst() const { return setMemPoolParents; }
+    const Children& GetMemPoolChildrenConst() const { return setMemPoolChildren; }
+    Parents& GetMemPoolParents() const { return setMemPoolParents; }
+    Children& GetMemPoolChildren() const { return setMemPoolChildren; }
+
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t nEpoch; //!< Last epoch in which a mempool traversal visited this entry
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -335,6 +369,41 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * Immutable copy of mempool entries and the links between them, for readers
+ * that serialize many entries (RPC, REST, BIP35 mempool requests). Readers
+ * only need mempool.cs while the entries are copied, and not while they go
+ * through them.
+ */
+class CTxMemPoolSnapshot
+{
+public:
+    struct Entry
+    {
+        //! Copy e and its parent links; the caller must hold the mempool's cs.
+        explicit Entry(const CTxMemPoolEntry& e);
+
+        CTxMemPoolEntry entry;
+        //! Txids of the in-mempool parents
+        std::vector<uint256> vParents;
+
+        const uint256& GetTxid() const { return entry.GetTx().GetHash(); }
+    };
+
+    //! The mempool's transactions updated counter when the snapshot was taken
+    unsigned int nTransactionsUpdated;
+    //! In the mempool's iteration order
+    std::vector<Entry> vEntries;
+    //! Positions in vEntries sorted by ancestor count and then score, which
+    //! puts parents before their children
+    std::vector<uint32_t> vSortedDepthAndScore;
+
+    explicit CTxMemPoolSnapshot(unsigned int nTransactionsUpdatedIn) : nTransactionsUpdated(nTransactionsUpdatedIn) {}
+
+    /** Fill vSortedDepthAndScore after vEntries was filled */
+    void SortDepthAndScore();
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -375,7 +444,7 @@ enum class MemPoolRemovalReason {
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
+ * the set of in-mempool direct parents and direct children in each entry.  Within
  * each CTxMemPoolEntry, we track the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
@@ -408,7 +477,7 @@ enum class MemPoolRemovalReason {
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -432,12 +501,19 @@ class CTxMemPool
 {
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
-    unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    std::atomic<unsigned int> nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation, and to tell when a snapshot is outdated
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    //! Backs the nodes of mapTx and the parent/child sets of its entries
+    CPoolResource poolResource;
+    size_t nPoolOverhead; //!< pool memory taken by an empty mapTx (its header node)
+
+    mutable uint64_t nEpoch; //!< Epoch of the current traversal, see EpochGuard
+    mutable bool fHasEpochGuard;
+
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
@@ -448,6 +524,8 @@ public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
 
+    typedef CPoolAllocator<CTxMemPoolEntry> entry_allocator;
+
     typedef boost::multi_index_container<
         CTxMemPoolEntry,
         boost::multi_index::indexed_by<
@@ -477,7 +555,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        entry_allocator
     > indexed_transaction_set;
 
     mutable CCriticalSection cs;
@@ -486,30 +565,42 @@ public:
     typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
     std::vector<std::pair<uint256, txiter> > vTxHashes; //!< All tx witness hashes/entries in mapTx, in random order
 
-    struct CompareIteratorByHash {
-        bool operator()(const txiter &a, const txiter &b) const {
-            return a->GetTx().GetHash() < b->GetTx().GetHash();
-        }
-    };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    const CTxMemPoolEntry::Parents & GetMemPoolParents(txiter entry) const;
+    const CTxMemPoolEntry::Children & GetMemPoolChildren(txiter entry) const;
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    /**
+     * Starts a traversal of the mempool graph. Entries are tagged with a fresh
+     * epoch as visited() sees them, so telling whether an entry was seen
+     * before is a comparison instead of a set lookup. Traversals don't nest.
+     */
+    class EpochGuard {
+        const CTxMemPool& pool;
+    public:
+        explicit EpochGuard(const CTxMemPool& in);
+        ~EpochGuard();
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    /** Whether the traversal in progress saw it before; marks it as seen. */
+    bool visited(txiter it) const
+    {
+        assert(fHasEpochGuard);
+        bool ret = it->nEpoch >= nEpoch;
+        it->nEpoch = std::max(it->nEpoch, nEpoch);
+        return ret;
+    }
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
-    std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
+    //! The last snapshot handed out, guarded by cs_snapshot
+    mutable std::shared_ptr<const CTxMemPoolSnapshot> snapshot;
+    mutable CCriticalSection cs_snapshot;
+    //! Held while a new snapshot is taken, so concurrent readers share it
+    mutable CCriticalSection cs_snapshotbuild;
 
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx;
@@ -545,7 +636,13 @@ public:
     void _clear(); //lock free
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
     void queryHashes(std::vector<uint256>& vtxid);
-    void pruneSpent(const uint256& hash, CCoins &coins);
+    /**
+     * Return a snapshot of all entries. The same snapshot is handed out until
+     * the mempool changes; taking a new one holds cs only while the entries
+     * are copied.
+     */
+    std::shared_ptr<const CTxMemPoolSnapshot> GetSnapshot() const;
+    bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
     /**
@@ -588,7 +685,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from the entry's links. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true) const;
 
@@ -606,10 +703,10 @@ public:
     CFeeRate GetMinFee(size_t sizelimit) const;
 
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
-      *  pvNoSpendsRemaining, if set, will be populated with the list of transactions
+      *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
       */
-    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining=NULL);
+    void TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining=NULL);
 
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -635,6 +732,13 @@ public:
         return (mapTx.count(hash) != 0);
     }
 
+    bool exists(const COutPoint& outpoint) const
+    {
+        LOCK(cs);
+        auto it = mapTx.find(outpoint.hash);
+        return (it != mapTx.end() && outpoint.n < it->GetTx().vout.size());
+    }
+
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
@@ -716,8 +820,8 @@ protected:
 
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn);
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
 };
 
 // We want to sort transactions by coin age priority
@@ -0,0 +1,130 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrelay.h"
+
+#include "txmempool.h"
+
+#include <algorithm>
+
+#include <boost/bind/bind.hpp>
+
+namespace {
+
+/** Fewest ancestors first, then highest fee rate, which puts parents before their children */
+class CompareIteratorByDepthAndScore
+{
+public:
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        uint64_t counta = a->GetCountWithAncestors();
+        uint64_t countb = b->GetCountWithAncestors();
+        if (counta == countb) {
+            return CompareTxMemPoolEntryByScore()(*a, *b);
+        }
+        return counta < countb;
+    }
+};
+
+} // anon namespace
+
+CTxRelayQueue::CTxRelayQueue(CTxMemPool& poolIn) : pool(poolIn), nFirstSequence(0), nNextBatch(0)
+{
+    pool.NotifyEntryRemoved.connect(boost::bind(&CTxRelayQueue::TransactionRemoved,
+                                                this, boost::placeholders::_1,
+                                                boost::placeholders::_2));
+}
+
+CTxRelayQueue::~CTxRelayQueue()
+{
+    pool.NotifyEntryRemoved.disconnect(boost::bind(&CTxRelayQueue::TransactionRemoved,
+                                                   this, boost::placeholders::_1,
+                                                   boost::placeholders::_2));
+}
+
+void CTxRelayQueue::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    std::unordered_map<uint256, uint64_t, SaltedTxidHasher>::iterator it = mapSequence.find(tx->GetHash());
+    if (it == mapSequence.end())
+        return;
+    deqAnnounced[it->second - nFirstSequence].tx.reset();
+    mapSequence.erase(it);
+}
+
+void CTxRelayQueue::Add(const uint256& txid)
+{
+    LOCK(cs);
+    vPending.push_back(txid);
+}
+
+void CTxRelayQueue::Update(int64_t nTimeMicros, bool fForce)
+{
+    std::vector<uint256> vBatch;
+    {
+        LOCK(cs);
+        if (vPending.empty() || (!fForce && nTimeMicros < nNextBatch))
+            return;
+        vBatch.swap(vPending);
+        nNextBatch = nTimeMicros + TX_RELAY_BATCH_INTERVAL;
+    }
+
+    // Keep the mempool locked until the batch is appended, so that a
+    // transaction removed in the meantime is either not found here, or
+    // found by TransactionRemoved.
+    LOCK(pool.cs);
+    std::vector<CTxMemPool::txiter> vIters;
+    vIters.reserve(vBatch.size());
+    for (const uint256& txid : vBatch) {
+        CTxMemPool::txiter it = pool.mapTx.find(txid);
+        if (it != pool.mapTx.end())
+            vIters.push_back(it);
+    }
+    std::sort(vIters.begin(), vIters.end(), CompareIteratorByDepthAndScore());
+    vIters.erase(std::unique(vIters.begin(), vIters.end()), vIters.end());
+
+    LOCK(cs);
+    for (const CTxMemPool::txiter& it : vIters) {
+        // A transaction that is relayed again moves to the end, so that the
+        // peers that connected since it was announced get it too
+        const uint256& txid = it->GetTx().GetHash();
+        std::pair<std::unordered_map<uint256, uint64_t, SaltedTxidHasher>::iterator, bool> ret = mapSequence.emplace(txid, nFirstSequence + deqAnnounced.size());
+        if (!ret.second) {
+            deqAnnounced[ret.first->second - nFirstSequence].tx.reset();
+            ret.first->second = nFirstSequence + deqAnnounced.size();
+        }
+        deqAnnounced.emplace_back(it->GetSharedTx(), CFeeRate(it->GetFee(), it->GetTxSize()));
+    }
+    while (deqAnnounced.size() > MAX_TX_RELAY_ANNOUNCEMENTS) {
+        if (deqAnnounced.front().tx)
+            mapSequence.erase(deqAnnounced.front().tx->GetHash());
+        deqAnnounced.pop_front();
+        nFirstSequence++;
+    }
+}
+
+uint64_t CTxRelayQueue::GetEndSequence() const
+{
+    LOCK(cs);
+    return nFirstSequence + deqAnnounced.size();
+}
+
+uint64_t CTxRelayQueue::ForEachFrom(uint64_t nSequence, const std::function<bool(const Announcement&)>& f) const
+{
+    LOCK(cs);
+    const uint64_t nEndSequence = nFirstSequence + deqAnnounced.size();
+    uint64_t n = std::max(nSequence, nFirstSequence);
+    for (; n < nEndSequence; n++) {
+        const Announcement& announcement = deqAnnounced[n - nFirstSequence];
+        if (announcement.tx && !f(announcement))
+            break;
+    }
+    return n;
+}
+
+size_t CTxRelayQueue::size() const
+{
+    LOCK(cs);
+    return deqAnnounced.size();
+}
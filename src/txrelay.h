@@ -0,0 +1,101 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRELAY_H
+#define BITCOIN_TXRELAY_H
+
+#include "amount.h"
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <functional>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+
+/** Interval at which newly relayed transactions are ordered and handed to the peers, in microseconds */
+static const int64_t TX_RELAY_BATCH_INTERVAL = 1000000;
+/** Number of announcements kept for peers that fall behind */
+static const size_t MAX_TX_RELAY_ANNOUNCEMENTS = 50000;
+
+/**
+ * Transaction announcements shared by all peers.
+ *
+ * Relayed transactions are collected, and once per TX_RELAY_BATCH_INTERVAL
+ * the new ones are looked up in the mempool, sorted by ancestor count and
+ * fee rate, and appended to a log of announcements, all under one mempool
+ * lock. Every peer keeps its position in the log and walks it at its own
+ * trickle time, applying only its own filters. The ordering is thus done
+ * once rather than once per peer, and peers need no mempool lookups.
+ *
+ * Announcements of transactions that left the mempool are skipped. Beyond
+ * MAX_TX_RELAY_ANNOUNCEMENTS the oldest announcements are dropped, and peers
+ * that fell that far behind go on with the oldest one left.
+ */
+class CTxRelayQueue
+{
+public:
+    struct Announcement
+    {
+        //! Reset once the transaction leaves the mempool, so that the log
+        //! doesn't keep it alive
+        CTransactionRef tx;
+        CFeeRate feeRate;
+
+        Announcement(const CTransactionRef& txIn, const CFeeRate& feeRateIn) : tx(txIn), feeRate(feeRateIn) {}
+    };
+
+private:
+    CTxMemPool& pool;
+
+    mutable CCriticalSection cs;
+    //! Relayed since the last batch, in relay order
+    std::vector<uint256> vPending;
+    std::deque<Announcement> deqAnnounced;
+    //! Sequence number of the front of deqAnnounced
+    uint64_t nFirstSequence;
+    //! Sequence numbers of the announcements that are still in the mempool
+    std::unordered_map<uint256, uint64_t, SaltedTxidHasher> mapSequence;
+    int64_t nNextBatch;
+
+    CTxRelayQueue(const CTxRelayQueue&);
+    CTxRelayQueue& operator=(const CTxRelayQueue&);
+
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+public:
+    explicit CTxRelayQueue(CTxMemPool& poolIn);
+    ~CTxRelayQueue();
+
+    /** Queue a transaction for announcement to all peers. */
+    void Add(const uint256& txid);
+
+    /**
+     * Announce the transactions added since the last batch, if
+     * TX_RELAY_BATCH_INTERVAL passed since then or fForce is set.
+     */
+    void Update(int64_t nTimeMicros, bool fForce = false);
+
+    /** The sequence number the next announcement gets; new peers start there. */
+    uint64_t GetEndSequence() const;
+
+    /**
+     * Call f for the announcements from nSequence on, skipping transactions
+     * that left the mempool, until f returns false. Returns the sequence
+     * number to continue from, which is that of the announcement f returned
+     * false for, if any.
+     */
+    uint64_t ForEachFrom(uint64_t nSequence, const std::function<bool(const Announcement&)>& f) const;
+
+    /** Number of announcements kept. */
+    size_t size() const;
+};
+
+#endif // BITCOIN_TXRELAY_H
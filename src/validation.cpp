@@ -5,14 +5,19 @@
 
 #include "validation.h"
 
+#include "addressindex.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "auxpowcache.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "dogecoin.h"
 #include "hash.h"
 #include "init.h"
@@ -29,6 +34,7 @@
 #include "timedata.h"
 #include "tinyformat.h"
 #include "txdb.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "undo.h"
@@ -69,6 +75,9 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
+bool fUTXOCommitment = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -93,6 +102,7 @@ CTxMemPool mempool(::minRelayTxFee);
  * in the last Consensus::Params::nMajorityWindow blocks, starting at pstart and going backwards.
  */
 static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned nRequired, const Consensus::Params& consensusParams);
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const CChainParams& chainparams);
 static void CheckBlockIndex(const Consensus::Params& consensusParams);
 
 /** Constant stuff for coinbase transactions we create: */
@@ -220,6 +230,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CCoinsViewDB *pcoinsdbview = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
@@ -409,15 +420,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -557,9 +568,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -584,9 +595,19 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
+/** Script verification flags for transactions entering the mempool */
+static unsigned int GetMempoolScriptFlags()
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -678,31 +699,27 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
         view.SetBackend(viewMemPool);
 
-        // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
-        }
-
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
-                if (pfMissingInputs)
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                coins_to_uncache.push_back(txin.prevout);
+            }
+            if (!view.HaveCoin(txin.prevout)) {
+                // Are inputs missing because we already have the tx?
+                for (size_t out = 0; out < tx.vout.size(); out++) {
+                    // Optimistically just do efficient check of cache for outputs
+                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out))) {
+                        return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+                    }
+                }
+                // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
+                if (pfMissingInputs) {
                     *pfMissingInputs = true;
+                }
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
             }
         }
 
-        // are the actual inputs available?
-        if (!view.HaveInputs(tx))
-            return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-inputs-spent");
-
         // Bring the best block into scope
         view.GetBestBlock();
 
@@ -744,8 +761,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // during reorgs to ensure COINBASE_MATURITY is still met.
         bool fSpendsCoinbase = false;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase()) {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (coin.IsCoinBase()) {
                 fSpendsCoinbase = true;
                 break;
             }
@@ -955,37 +972,39 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!Params().RequireStandard()) {
-            scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        unsigned int scriptVerifyFlags = GetMempoolScriptFlags();
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
+        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
             CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
+            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
+                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
                 // Only the witness is missing, so the transaction itself may be fine.
                 state.SetCorruptionPossible();
             }
             return false; // state filled in by CheckInputs
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
+        // Check again against the consensus-critical script verification
+        // flags of the current tip, in case of bugs in the standard flags that
+        // cause transactions to pass as valid when they're actually invalid.
+        // For instance the STRICTENC flag was incorrectly allowing certain
         // CHECKSIG NOT scripts to pass, even though they were invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        //
+        // The result is stored in the script execution cache, so that the
+        // scripts are not run again when the transaction is mined, as long
+        // as the next block has the same flags as the tip.
+        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params());
+        if (!CheckInputs(tx, state, view, true, currentBlockScriptVerifyFlags, true, true, txdata))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
@@ -1030,10 +1049,10 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                         bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> coins_to_uncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+        BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
     }
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
@@ -1063,9 +1082,9 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
         return true;
     }
 
-    if (fTxIndex) {
+    if (g_txindex) {
         CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
+        if (g_txindex->FindTx(hash, postx)) {
             CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
@@ -1087,10 +1106,9 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
         int nHeight = -1;
         {
-            const CCoinsViewCache& view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
+            const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+            if (!coin.IsSpent())
+                nHeight = coin.nHeight;
         }
         if (nHeight > 0)
             pindexSlow = chainActive[nHeight];
@@ -1143,6 +1161,33 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+/**
+ * Find the record at pos in a block or undo file through the block file map.
+ * Records are preceded by the message start and their size, and followed by
+ * nExtra more bytes (the checksum of undo records).  On success, pbegin points
+ * at the record, which stays valid as long as the returned mapping is held.
+ */
+static std::shared_ptr<const CMappedFile> MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, size_t nExtra, const unsigned char*& pbegin, unsigned int& nSize)
+{
+    if (pos.IsNull() || pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize))
+        return nullptr;
+    std::shared_ptr<const CMappedFile> file = blockFileMap.Get(pos, prefix, pos.nPos);
+    if (!file)
+        return nullptr;
+    const unsigned char* pheader = file->begin() + pos.nPos - CMessageHeader::MESSAGE_START_SIZE - sizeof(nSize);
+    if (memcmp(pheader, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+        return nullptr;
+    nSize = ReadLE32(pheader + CMessageHeader::MESSAGE_START_SIZE);
+    const size_t nEnd = (size_t)pos.nPos + nSize + nExtra;
+    if (nEnd > file->size()) {
+        file = blockFileMap.Get(pos, prefix, nEnd);
+        if (!file)
+            return nullptr;
+    }
+    pbegin = file->begin() + pos.nPos;
+    return file;
+}
+
 /* Generic implementation of block reading that can handle
    both a block and its header.  */
 
@@ -1151,17 +1196,31 @@ static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensu
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    const unsigned char* pbegin = NULL;
+    unsigned int nSize = 0;
+    std::shared_ptr<const CMappedFile> mapped = MapDiskRecord(pos, "blk", 0, pbegin, nSize);
+    if (mapped) {
+        // Read block from the mapped file
+        try {
+            CBufferReader reader(SER_DISK, CLIENT_VERSION, pbegin, nSize);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1197,6 +1256,47 @@ bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, con
     return ReadBlockOrHeader(block, pindex, consensusParams, fCheckPOW);
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const uint256& hash)
+{
+    const unsigned char* pbegin = NULL;
+    unsigned int nSize = 0;
+    std::shared_ptr<const CMappedFile> mapped = MapDiskRecord(pos, "blk", 0, pbegin, nSize);
+    if (mapped) {
+        vchBlock.assign(pbegin, pbegin + nSize);
+    } else {
+        if (pos.IsNull() || pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize))
+            return error("%s: Invalid position %s", __func__, pos.ToString());
+        CDiskBlockPos posHeader(pos.nFile, pos.nPos - CMessageHeader::MESSAGE_START_SIZE - sizeof(nSize));
+        CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+        try {
+            CMessageHeader::MessageStartChars messageStart;
+            filein >> FLATDATA(messageStart) >> nSize;
+            if (memcmp(messageStart, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+            if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                return error("%s: Block size %u too large at %s", __func__, nSize, pos.ToString());
+            vchBlock.resize(nSize);
+            filein.read((char*)vchBlock.data(), nSize);
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    }
+
+    // The block was checked when it was stored; only make sure these are its bytes.
+    if (vchBlock.size() < 80 || Hash(vchBlock.begin(), vchBlock.begin() + 80) != hash)
+        return error("%s: Block at %s doesn't match index for %s", __func__, pos.ToString(), hash.ToString());
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex)
+{
+    return ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), pindex->GetBlockHash());
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1348,24 +1448,14 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
             // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -1377,12 +1467,30 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
-    if (!VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *txdata), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *txdata, pubkeycache), &error)) {
         return false;
     }
     return true;
 }
 
+bool CHeaderCheck::operator()() {
+    std::vector<const CPureBlockHeader*> vPoWHeaders;
+    vPoWHeaders.reserve(pend - pbegin);
+    for (const CBlockHeader* pheader = pbegin; pheader != pend; ++pheader)
+        vPoWHeaders.push_back(&GetPoWHeader(*pheader));
+    std::vector<uint256> vPoWHashes;
+    CPureBlockHeader::GetPoWHashBatch(vPoWHeaders, vPoWHashes);
+
+    bool fOk = true;
+    for (size_t i = 0; i < vPoWHashes.size(); i++) {
+        if (!CheckAuxPowProofOfWork(pbegin[i], vPoWHashes[i], *params)) {
+            pfInvalid[i] = 1;
+            fOk = false;
+        }
+    }
+    return fOk;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1403,22 +1511,22 @@ bool CheckTxInputs(const CChainParams& params, const CTransaction& tx, CValidati
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase()) {
+            if (coin.IsCoinBase()) {
                 // Dogecoin: Switch maturity at depth 145,000
-                int nCoinbaseMaturity = params.GetConsensus(coins->nHeight).nCoinbaseMaturity;
-                if (nSpendHeight - coins->nHeight < nCoinbaseMaturity)
+                int nCoinbaseMaturity = params.GetConsensus(coin.nHeight).nCoinbaseMaturity;
+                if (nSpendHeight - (int)coin.nHeight < nCoinbaseMaturity)
                     return state.Invalid(false,
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
         }
@@ -1438,7 +1546,78 @@ bool CheckTxInputs(const CChainParams& params, const CTransaction& tx, CValidati
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
+namespace {
+
+/**
+ * Transactions whose scripts were all found valid under a set of script
+ * verification flags, so that mempool transactions don't have their scripts
+ * run again when they are mined. Entries are SHA256(nonce || wtxid || flags).
+ */
+class CScriptExecutionCache
+{
+private:
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs;
+
+public:
+    CScriptExecutionCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const CTransaction& tx, unsigned int flags)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs);
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+
+    void GetEntries(uint256& nonceOut, std::vector<uint256>& vEntries)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs);
+        nonceOut = nonce;
+        setValid.for_each([&vEntries](const uint256& entry) { vEntries.push_back(entry); });
+    }
+
+    void SetEntries(const uint256& nonceIn, const std::vector<uint256>& vEntries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs);
+        nonce = nonceIn;
+        for (const uint256& entry : vEntries)
+            setValid.insert(entry);
+    }
+};
+
+CScriptExecutionCache scriptExecutionCache;
+
+} // anon namespace
+
+void InitScriptExecutionCache()
+{
+    // Gets the half of -maxsigcachesize that the signature cache leaves.
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, CPubKeyParseCache *pubkeycache)
 {
     if (!tx.IsCoinBase())
     {
@@ -1458,13 +1637,29 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // Of course, if an assumed valid block is invalid due to false scriptSigs
         // this optimization would allow an invalid chain to be accepted.
         if (fScriptChecks) {
+            // First check if the scripts of this transaction were found valid
+            // with the same flags before. This assumes that the inputs are
+            // the ones committed to by the transaction's prevouts.
+            uint256 hashCacheEntry;
+            scriptExecutionCache.ComputeEntry(hashCacheEntry, tx, flags);
+            if (scriptExecutionCache.Get(hashCacheEntry, !cacheFullScriptStore))
+                return true;
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
+
+                // We very carefully only pass in things to CScriptCheck which
+                // are clearly committed to by tx' witness hash. This provides
+                // a sanity check that our caching is not introducing consensus
+                // failures through additional data in, eg, the coins being
+                // spent being checked as a part of CScriptCheck.
+                const CScript& scriptPubKey = coin.out.scriptPubKey;
+                const CAmount amount = coin.out.nValue;
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheSigStore, &txdata, pubkeycache);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1476,8 +1671,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
+                        CScriptCheck check2(scriptPubKey, amount, tx, i,
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1491,6 +1686,11 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // We ran all of the scripts and were told to cache the result.
+                scriptExecutionCache.Set(hashCacheEntry);
+            }
         }
     }
 
@@ -1528,19 +1728,34 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Read block
     uint256 hashChecksum;
-    try {
-        filein >> blockundo;
-        filein >> hashChecksum;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    const unsigned char* pbegin = NULL;
+    unsigned int nSize = 0;
+    std::shared_ptr<const CMappedFile> mapped = MapDiskRecord(pos, "rev", sizeof(hashChecksum), pbegin, nSize);
+    if (mapped) {
+        // Read undo data from the mapped file
+        try {
+            CBufferReader reader(SER_DISK, CLIENT_VERSION, pbegin, nSize + sizeof(hashChecksum));
+            reader >> blockundo;
+            reader >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenUndoFile failed", __func__);
+
+        // Read block
+        try {
+            filein >> blockundo;
+            filein >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Verify checksum
@@ -1574,39 +1789,35 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 } // anon namespace
 
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the UTXO in a Coin at a given COutPoint
+ * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
-    }
-    if (coins->IsAvailable(out.n))
+    if (view.HaveCoin(out))
         fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height and coinbase). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("%s: undo data adding output to missing transaction", __func__);
+        undo.nHeight = alternate.nHeight;
+        undo.fCoinBase = alternate.fCoinBase;
+    }
+    view.AddCoin(out, std::move(undo), !fClean);
 
     return fClean;
 }
 
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fUpdateIndexes)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -1625,44 +1836,67 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
+    // Collect the index changes before the undo data is moved into the view
+    CAddressIndexUpdate addressIndexUpdate;
+    if (fAddressIndex && fUpdateIndexes)
+        GetAddressIndexUpdate(block, blockUndo, pindex->nHeight, false, addressIndexUpdate);
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpent;
+    CCoinsSetHash hashSetDelta;
+    const bool fUpdateCommitment = fUTXOCommitment && fUpdateIndexes;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = *(block.vtx[i]);
         uint256 hash = tx.GetHash();
 
+        bool is_coinbase = tx.IsCoinBase();
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-
-        // remove outputs
-        outs->Clear();
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                if (!is_spent || tx.vout[o] != coin.out || (unsigned int)pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase)
+                    fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
+                if (is_spent && fUpdateCommitment)
+                    hashSetDelta.Remove(out, coin);
+            }
         }
 
         // restore inputs
         if (i > 0) { // not coinbases
-            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(): transaction and undo data inconsistent");
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
+                if (fSpentIndex && fUpdateIndexes)
+                    vSpent.emplace_back(out, CSpentIndexValue());
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out))
                     fClean = false;
+                if (fUpdateCommitment && view.HaveCoin(out))
+                    hashSetDelta.Add(out, view.AccessCoin(out));
             }
         }
     }
 
+    if (fAddressIndex && fUpdateIndexes && !pblocktree->UpdateAddressIndex(addressIndexUpdate, false))
+        return AbortNode(state, "Failed to write address index");
+    if (fSpentIndex && fUpdateIndexes && !pblocktree->UpdateSpentIndex(vSpent))
+        return AbortNode(state, "Failed to write spent index");
+    if (fUpdateCommitment) {
+        // Blocks connected before the commitment was enabled lack one, so
+        // fill it in for the block we return to
+        CCoinsSetHash hashSet;
+        if (pblocktree->ReadUTXOCommitment(pindex->GetBlockHash(), hashSet)) {
+            hashSet.Combine(hashSetDelta);
+            if (!pblocktree->WriteUTXOCommitment(pindex->pprev->GetBlockHash(), hashSet))
+                return AbortNode(state, "Failed to write UTXO set commitment");
+        }
+    }
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -1680,6 +1914,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // Mappings may extend past the end of truncated files.
+    if (fFinalize)
+        blockFileMap.Invalidate(nLastBlockFile);
+
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -1706,6 +1944,413 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** Number of headers checked by one CHeaderCheck, a multiple of the scrypt lane counts */
+static const unsigned int HEADER_CHECK_RANGE = 32;
+
+static CCheckQueue<CHeaderCheck> headercheckqueue(4);
+
+void ThreadHeaderCheck() {
+    RenameThread("dogecoin-headerch");
+    headercheckqueue.Thread();
+}
+
+namespace {
+
+/** A block record read from a block file by LoadExternalBlockFile */
+struct CImportBlock
+{
+    //! Position of the block data, if it was read from one of our own block files
+    CDiskBlockPos pos;
+    bool fHavePos;
+    //! The raw record, released once it has been deserialized
+    CDataStream ssData;
+    //! The deserialized block; NULL if the record could not be deserialized
+    std::shared_ptr<CBlock> pblock;
+
+    CImportBlock() : fHavePos(false), ssData(SER_DISK, CLIENT_VERSION) {}
+};
+
+/**
+ * Closure representing the context-free checks of a range of blocks read by
+ * LoadExternalBlockFile: deserialization, proof of work (hashed together so
+ * that multi-lane scrypt can be used) and CheckBlock.  Blocks that pass are
+ * marked as checked, so that AcceptBlock skips the work under cs_main.
+ * Failures are left for AcceptBlock to report, so this always returns true.
+ */
+class CBlockImportCheck
+{
+private:
+    CImportBlock *pbegin;
+    CImportBlock *pend;
+    const Consensus::Params *params;
+
+public:
+    CBlockImportCheck(): pbegin(NULL), pend(NULL), params(NULL) {}
+    CBlockImportCheck(CImportBlock *pbeginIn, CImportBlock *pendIn, const Consensus::Params& paramsIn) :
+        pbegin(pbeginIn), pend(pendIn), params(&paramsIn) { }
+
+    bool operator()() {
+        std::vector<const CBlock*> vBlocks;
+        std::vector<const CPureBlockHeader*> vPoWHeaders;
+        for (CImportBlock* pimport = pbegin; pimport != pend; ++pimport) {
+            try {
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                pimport->ssData >> *pblock;
+                pimport->pblock = pblock;
+                vBlocks.push_back(pblock.get());
+                vPoWHeaders.push_back(&GetPoWHeader(*pblock));
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+            pimport->ssData = CDataStream(SER_DISK, CLIENT_VERSION);
+        }
+        std::vector<uint256> vPoWHashes;
+        CPureBlockHeader::GetPoWHashBatch(vPoWHeaders, vPoWHashes);
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            CValidationState state;
+            if (CheckAuxPowProofOfWork(*vBlocks[i], vPoWHashes[i], *params) && CheckBlock(*vBlocks[i], state, false))
+                vBlocks[i]->fChecked = true;
+        }
+        return true;
+    }
+
+    void swap(CBlockImportCheck &check) {
+        std::swap(pbegin, check.pbegin);
+        std::swap(pend, check.pend);
+        std::swap(params, check.params);
+    }
+};
+
+} // anon namespace
+
+/** Number of blocks checked by one CBlockImportCheck, a multiple of the scrypt lane counts */
+static const unsigned int IMPORT_CHECK_RANGE = 8;
+
+static CCheckQueue<CBlockImportCheck> blockimportqueue(1);
+
+void ThreadBlockImportCheck() {
+    RenameThread("dogecoin-importch");
+    blockimportqueue.Thread();
+}
+
+namespace {
+
+/**
+ * Closure representing the lookup of a range of a block's prevouts in the
+ * view backing pcoinsTip. Coins that are not found are left spent.
+ */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsView *view;
+    const COutPoint *pbegin;
+    const COutPoint *pend;
+    Coin *pcoins;
+
+public:
+    CCoinsPrefetchCheck(): view(NULL), pbegin(NULL), pend(NULL), pcoins(NULL) {}
+    CCoinsPrefetchCheck(const CCoinsView& viewIn, const COutPoint *pbeginIn, const COutPoint *pendIn, Coin *pcoinsIn) :
+        view(&viewIn), pbegin(pbeginIn), pend(pendIn), pcoins(pcoinsIn) { }
+
+    bool operator()() {
+        Coin *pcoin = pcoins;
+        for (const COutPoint *pout = pbegin; pout != pend; ++pout, ++pcoin) {
+            if (!view->GetCoin(*pout, *pcoin))
+                pcoin->Clear();
+        }
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck &check) {
+        std::swap(view, check.view);
+        std::swap(pbegin, check.pbegin);
+        std::swap(pend, check.pend);
+        std::swap(pcoins, check.pcoins);
+    }
+};
+
+} // anon namespace
+
+/** Number of prevouts looked up by one CCoinsPrefetchCheck */
+static const unsigned int PREFETCH_CHECK_RANGE = 8;
+
+static CCheckQueue<CCoinsPrefetchCheck> prefetchqueue(1);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("dogecoin-prefetch");
+    prefetchqueue.Thread();
+}
+
+/**
+ * Load the coins spent by a block that are not in pcoinsTip yet, reading
+ * them from the database on the prefetch threads at the same time, so that
+ * ConnectBlock does not have to wait for one read after another.
+ */
+static void PrefetchInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0)
+        return;
+
+    std::set<uint256> setBlockTxids;
+    for (const auto& tx : block.vtx)
+        setBlockTxids.insert(tx->GetHash());
+    std::vector<COutPoint> vOutPoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            // Outputs created in the block itself are never in the database.
+            if (!setBlockTxids.count(txin.prevout.hash) && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                vOutPoints.push_back(txin.prevout);
+        }
+    }
+    if (vOutPoints.empty())
+        return;
+
+    std::vector<Coin> vCoins(vOutPoints.size());
+    {
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&prefetchqueue);
+        std::vector<CCoinsPrefetchCheck> vChecks;
+        for (size_t i = 0; i < vOutPoints.size(); i += PREFETCH_CHECK_RANGE) {
+            const size_t nEnd = std::min(i + PREFETCH_CHECK_RANGE, vOutPoints.size());
+            vChecks.emplace_back(*pcoinsTip->GetBackend(), &vOutPoints[i], vOutPoints.data() + nEnd, &vCoins[i]);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        if (!vCoins[i].IsSpent())
+            pcoinsTip->CacheCoin(vOutPoints[i], std::move(vCoins[i]));
+    }
+}
+
+namespace {
+
+/** A transaction to verify ahead of AcceptToMemoryPool, and the outputs it spends */
+struct CTxPreVerify
+{
+    CTransactionRef ptx;
+    std::vector<CTxOut> vSpent;
+    unsigned int nFlags;
+};
+
+/**
+ * Closure representing the script verification of one transaction ahead of
+ * AcceptToMemoryPool. Valid signatures go to the signature cache, and if all
+ * inputs pass, the transaction goes to the script execution cache for these
+ * flags. Failures are left for AcceptToMemoryPool to report, so this always
+ * returns true.
+ */
+class CTxPreVerifyCheck
+{
+private:
+    const CTxPreVerify *ppreverify;
+
+public:
+    CTxPreVerifyCheck(): ppreverify(NULL) {}
+    explicit CTxPreVerifyCheck(const CTxPreVerify& preverifyIn) : ppreverify(&preverifyIn) { }
+
+    bool operator()() {
+        const CTransaction& tx = *ppreverify->ptx;
+        PrecomputedTransactionData txdata(tx);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const CTxOut& spent = ppreverify->vSpent[i];
+            CScriptCheck check(spent.scriptPubKey, spent.nValue, tx, i, ppreverify->nFlags, true, &txdata);
+            if (!check())
+                return true;
+        }
+        uint256 hashCacheEntry;
+        scriptExecutionCache.ComputeEntry(hashCacheEntry, tx, ppreverify->nFlags);
+        scriptExecutionCache.Set(hashCacheEntry);
+        return true;
+    }
+
+    void swap(CTxPreVerifyCheck &check) {
+        std::swap(ppreverify, check.ppreverify);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CTxPreVerifyCheck> txpreverifyqueue(1);
+
+void ThreadTxPreVerify() {
+    RenameThread("dogecoin-txprevfy");
+    txpreverifyqueue.Thread();
+}
+
+/**
+ * Find the output spent by prevout among the transactions being verified, in
+ * the mempool or in the UTXO set. Coins are read from the database without
+ * being added to pcoinsTip, which would have to be undone if the transaction
+ * is rejected. The content of an output never changes once its transaction
+ * exists, so it does not matter whether it is still unspent.
+ */
+static bool GetPreVerifyOutput(const CTxMemPool& pool, const std::map<uint256, const CTransaction*>& mapBatch, const COutPoint& prevout, CTxOut& out)
+{
+    AssertLockHeld(cs_main);
+    const CTransaction* ptxPrev = NULL;
+    CTransactionRef ptxMempool;
+    std::map<uint256, const CTransaction*>::const_iterator it = mapBatch.find(prevout.hash);
+    if (it != mapBatch.end()) {
+        ptxPrev = it->second;
+    } else {
+        ptxMempool = pool.get(prevout.hash);
+        ptxPrev = ptxMempool.get();
+    }
+    if (ptxPrev) {
+        if (prevout.n >= ptxPrev->vout.size())
+            return false;
+        out = ptxPrev->vout[prevout.n];
+        return true;
+    }
+
+    Coin coin;
+    if (pcoinsTip->HaveCoinInCache(prevout))
+        coin = pcoinsTip->AccessCoin(prevout);
+    else if (!pcoinsTip->GetBackend()->GetCoin(prevout, coin))
+        return false;
+    if (coin.IsSpent())
+        return false;
+    out = coin.out;
+    return true;
+}
+
+void PreVerifyTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx)
+{
+    std::vector<CTransactionRef> vCandidates;
+    std::map<uint256, const CTransaction*> mapBatch;
+    for (const CTransactionRef& ptx : vtx) {
+        CValidationState state;
+        if (ptx->IsCoinBase() || !CheckTransaction(*ptx, state))
+            continue;
+        vCandidates.push_back(ptx);
+        mapBatch[ptx->GetHash()] = ptx.get();
+    }
+    if (vCandidates.empty())
+        return;
+
+    // Look up the spent outputs, and apply the cheap checks that
+    // AcceptToMemoryPool makes before the scripts, so that transactions it
+    // would reject anyway cost no script verification.
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<CTxPreVerify> vPreVerify;
+    vPreVerify.reserve(vCandidates.size());
+    {
+        LOCK2(cs_main, pool.cs);
+        const bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus(chainActive.Height()));
+        const CFeeRate mempoolMinFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        const unsigned int nFlags = GetMempoolScriptFlags();
+        CCoinsView dummy;
+        for (const CTransactionRef& ptx : vCandidates) {
+            const CTransaction& tx = *ptx;
+            const uint256& hash = tx.GetHash();
+            std::string reason;
+            if (pool.exists(hash) || !CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
+                continue;
+            if (!GetBoolArg("-prematurewitness", false) && tx.HasWitness() && !witnessEnabled)
+                continue;
+            if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled))
+                continue;
+
+            CTxPreVerify preverify;
+            preverify.ptx = ptx;
+            preverify.nFlags = nFlags;
+            preverify.vSpent.resize(tx.vin.size());
+            CCoinsViewCache view(&dummy);
+            bool fHaveInputs = true;
+            for (unsigned int i = 0; fHaveInputs && i < tx.vin.size(); i++) {
+                fHaveInputs = GetPreVerifyOutput(pool, mapBatch, tx.vin[i].prevout, preverify.vSpent[i]);
+                if (fHaveInputs)
+                    view.AddCoin(tx.vin[i].prevout, Coin(preverify.vSpent[i], MEMPOOL_HEIGHT, false), true);
+            }
+            if (!fHaveInputs)
+                continue;
+            if (fRequireStandard && (!AreInputsStandard(tx, view) || (tx.HasWitness() && !IsWitnessStandard(tx, view))))
+                continue;
+            const int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+            if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+                continue;
+
+            const CAmount nValueIn = view.GetValueIn(tx);
+            if (!MoneyRange(nValueIn) || nValueIn < tx.GetValueOut())
+                continue;
+            CAmount nModifiedFees = nValueIn - tx.GetValueOut();
+            double nPriorityDummy = 0;
+            pool.ApplyDeltas(hash, nPriorityDummy, nModifiedFees);
+            // Free transactions are rate limited, and rarely worth verifying early
+            const unsigned int nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+            if (nModifiedFees < mempoolMinFee.GetFee(nSize) || nModifiedFees < GetDogecoinMinRelayFee(tx, nSize, false))
+                continue;
+
+            vPreVerify.push_back(std::move(preverify));
+        }
+    }
+    int64_t nTimeLookup = GetTimeMicros();
+
+    // A single transaction is verified right here, so that threads handing
+    // in one transaction each (such as RPC threads) verify at the same time;
+    // a batch is spread over the script check threads.
+    if (vPreVerify.size() == 1 || nScriptCheckThreads == 0) {
+        for (const CTxPreVerify& preverify : vPreVerify)
+            CTxPreVerifyCheck(preverify)();
+    } else if (!vPreVerify.empty()) {
+        CCheckQueueControl<CTxPreVerifyCheck> control(&txpreverifyqueue);
+        std::vector<CTxPreVerifyCheck> vChecks;
+        vChecks.reserve(vPreVerify.size());
+        for (const CTxPreVerify& preverify : vPreVerify)
+            vChecks.emplace_back(preverify);
+        control.Add(vChecks);
+        control.Wait();
+    }
+    int64_t nTimeVerify = GetTimeMicros();
+    LogPrint("bench", "Pre-verified %u of %u transactions: %.2fms looking up inputs, %.2fms verifying\n",
+             vPreVerify.size(), vtx.size(), 0.001 * (nTimeLookup - nTimeStart), 0.001 * (nTimeVerify - nTimeLookup));
+}
+
+/** Maximum number of blocks LoadExternalBlockFile reads ahead in one batch */
+static const unsigned int IMPORT_BATCH_BLOCKS = 256;
+/** Maximum size of the block records LoadExternalBlockFile reads ahead in one batch */
+static const size_t IMPORT_BATCH_SIZE = 32 * 1024 * 1024;
+/** Maximum size of the out-of-order blocks kept in memory until their parent is stored */
+static const size_t MAX_IMPORT_UNKNOWN_PARENT_SIZE = 64 * 1024 * 1024;
+
+namespace {
+
+/** A block read by LoadExternalBlockFile whose parent is not known yet */
+struct CImportOrphan
+{
+    CDiskBlockPos pos;
+    bool fHavePos;
+    //! The block itself while there is room, otherwise it is read again from pos
+    std::shared_ptr<const CBlock> pblock;
+    size_t nSize;
+};
+
+} // anon namespace
+
+/** Blocks with unknown parent, by parent hash (protected by cs_main) */
+static std::multimap<uint256, CImportOrphan> mapBlocksUnknownParent;
+/** Serialized size of the blocks held in mapBlocksUnknownParent (protected by cs_main) */
+static size_t nBlocksUnknownParentSize = 0;
+
+void ThreadTxIndex() {
+    RenameThread("dogecoin-txindex");
+    if (!g_txindex->ThreadSync()) {
+        CValidationState state;
+        AbortNode(state, "Failed to write transaction index");
+    }
+}
+
+void ThreadFlushCoins() {
+    RenameThread("dogecoin-coinsflush");
+    if (!pcoinsdbview->ThreadFlush()) {
+        CValidationState state;
+        AbortNode(state, "Failed to write to coin database");
+    }
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1759,6 +2404,41 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    const Consensus::Params& consensus = chainparams.GetConsensus(pindex->nHeight);
+
+    // BIP16 didn't become active until Apr 1 2012
+    // Dogecoin: BIP16 has been enabled since inception
+    bool fStrictPayToScriptHash = true;
+
+    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+
+    // Start enforcing the DERSIG (BIP66) rule
+    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP66Height) {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
+    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP65Height) {
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    // Start enforcing BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    if (VersionBitsState(pindex->pprev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
+        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    }
+
+    // Start enforcing WITNESS rules using versionbits logic.
+    if (IsWitnessEnabled(pindex->pprev, consensus)) {
+        flags |= SCRIPT_VERIFY_WITNESS;
+        flags |= SCRIPT_VERIFY_NULLDUMMY;
+    }
+
+    return flags;
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
                   CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
 {
@@ -1778,8 +2458,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == Params().GetConsensus(0).hashGenesisBlock) {
-        if (!fJustCheck)
+        if (!fJustCheck) {
             view.SetBestBlock(pindex->GetBlockHash());
+            if (fUTXOCommitment && !pblocktree->WriteUTXOCommitment(pindex->GetBlockHash(), CCoinsSetHash()))
+                return AbortNode(state, "Failed to write UTXO set commitment");
+        }
         return true;
     }
 
@@ -1839,56 +2522,38 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         for (const auto& tx : block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx->GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx->vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx->GetHash(), o))) {
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+                }
+            }
         }
     }
 
-    // BIP16 didn't become active until Apr 1 2012
-    // Dogecoin: BIP16 has been enabled since inception
-    bool fStrictPayToScriptHash = true;
-
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
-
-    // Start enforcing the DERSIG (BIP66) rule
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP66Height) {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP65Height) {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
+    unsigned int flags = GetBlockScriptFlags(pindex, chainparams);
 
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    // Start enforcing BIP68 (sequence locks) using versionbits logic.
     int nLockTimeFlags = 0;
     if (VersionBitsState(pindex->pprev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
         nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
     }
 
-    // Start enforcing WITNESS rules using versionbits logic.
-    if (IsWitnessEnabled(pindex->pprev, consensus)) {
-        flags |= SCRIPT_VERIFY_WITNESS;
-        flags |= SCRIPT_VERIFY_NULLDUMMY;
-    }
-
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
 
+    // Shared by this block's script checks, so it has to outlive control
+    CPubKeyParseCache pubkeycache;
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     std::vector<int> prevheights;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpent;
+    CCoinsSetHash hashSetDelta;
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -1909,7 +2574,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
@@ -1934,7 +2599,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL, &pubkeycache))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
@@ -1945,9 +2610,22 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        if (fSpentIndex && i > 0) {
+            for (unsigned int j = 0; j < tx.vin.size(); j++)
+                vSpent.emplace_back(tx.vin[j].prevout, CSpentIndexValue(tx.GetHash(), j, pindex->nHeight));
+        }
+        if (fUTXOCommitment && !fJustCheck) {
+            if (i > 0) {
+                const CTxUndo& txundo = blockundo.vtxundo.back();
+                for (unsigned int j = 0; j < tx.vin.size(); j++)
+                    hashSetDelta.Remove(tx.vin[j].prevout, txundo.vprevout[j]);
+            }
+            for (unsigned int o = 0; o < tx.vout.size(); o++) {
+                if (!tx.vout[o].scriptPubKey.IsUnspendable())
+                    hashSetDelta.Add(COutPoint(tx.GetHash(), o), Coin(tx.vout[o], pindex->nHeight, i == 0));
+            }
+        }
 
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
@@ -1962,7 +2640,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (!control.Wait())
         return state.DoS(100, false);
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
-    LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
+    LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs] (%u pubkeys parsed, %u reused)\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001, pubkeycache.Size(), pubkeycache.GetHits());
 
     if (fJustCheck)
         return true;
@@ -1986,9 +2664,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
+    if (fAddressIndex) {
+        CAddressIndexUpdate update;
+        GetAddressIndexUpdate(block, blockundo, pindex->nHeight, true, update);
+        if (!pblocktree->UpdateAddressIndex(update, true))
+            return AbortNode(state, "Failed to write address index");
+    }
+    if (fSpentIndex && !pblocktree->UpdateSpentIndex(vSpent))
+        return AbortNode(state, "Failed to write spent index");
+    if (fUTXOCommitment) {
+        // Chain the commitment on from the previous block's, if that has one
+        CCoinsSetHash hashSet;
+        if (pblocktree->ReadUTXOCommitment(hashPrevBlock, hashSet)) {
+            hashSet.Combine(hashSetDelta);
+            if (!pblocktree->WriteUTXOCommitment(pindex->GetBlockHash(), hashSet))
+                return AbortNode(state, "Failed to write UTXO set commitment");
+        }
+    }
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2096,16 +2788,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
+        // With -chainstatebgflush the write itself continues on the flush
+        // thread, unless the caller needs it on disk before we return.
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        if (mode == FLUSH_STATE_ALWAYS && !pcoinsdbview->WaitForFlush())
+            return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -2206,7 +2902,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, true))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
@@ -2248,6 +2944,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2287,6 +2984,10 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchInputs(blockConnecting);
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+    LogPrint("bench", "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001);
+    nTime2 = nTimePrefetched;
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2695,6 +3396,9 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
+    // Keep the auxpow around so that serving this header does not need a disk read
+    if (block.auxpow)
+        auxpowCache.Insert(hash, *block.auxpow, true);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
@@ -3131,7 +3835,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const CB
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3150,7 +3854,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, state, fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3183,11 +3887,39 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Run the context-free checks of all headers before taking cs_main,
+    // spreading them over the header check threads.  Each check hashes its
+    // range of headers together so that multi-lane scrypt can be used.
+    std::vector<char> vInvalid(headers.size(), 0);
+    {
+        std::vector<CHeaderCheck> vChecks;
+        vChecks.reserve((headers.size() + HEADER_CHECK_RANGE - 1) / HEADER_CHECK_RANGE);
+        for (size_t i = 0; i < headers.size(); i += HEADER_CHECK_RANGE) {
+            const size_t nEnd = std::min(headers.size(), i + HEADER_CHECK_RANGE);
+            vChecks.push_back(CHeaderCheck(&headers[i], &headers[0] + nEnd, chainparams.GetConsensus(0), &vInvalid[i]));
+        }
+        if (nScriptCheckThreads && vChecks.size() > 1) {
+            CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            BOOST_FOREACH(CHeaderCheck& check, vChecks)
+                if (!check())
+                    break;
+        }
+    }
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (vInvalid[i]) {
+            state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
+            return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, headers[i].GetHash().ToString(), FormatStateMessage(state));
+        }
+    }
+
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, false)) {
                 return false;
             }
             if (ppindex) {
@@ -3210,7 +3942,8 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
     CBlockIndex *pindexDummy = NULL;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    // A block that passed CheckBlock already had its proof of work checked.
+    if (!AcceptBlockHeader(block, state, chainparams, &pindex, !block.fChecked))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3404,6 +4137,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMap.Invalidate(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3644,14 +4378,26 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
+    // Check whether we have an address index
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+
+    // Check whether we have a spent index
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
+
+    return true;
+}
+
+void LoadChainTip(const CChainParams& chainparams)
+{
+    if (chainActive.Tip() && chainActive.Tip()->GetBlockHash() == pcoinsTip->GetBestBlock())
+        return;
 
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
-        return true;
+        return;
     chainActive.SetTip(it->second);
 
     PruneBlockIndexCandidates();
@@ -3660,8 +4406,6 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(),
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
         GuessVerificationProgress(chainparams.TxData(), chainActive.Tip()));
-
-    return true;
 }
 
 CVerifyDB::CVerifyDB()
@@ -3767,6 +4511,93 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     return true;
 }
 
+/** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
+static bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, params.GetConsensus(pindex->nHeight))) {
+        return error("ReplayBlock(): ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+    }
+
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn &txin : tx->vin) {
+                inputs.SpendCoin(txin.prevout);
+            }
+        }
+        // Pass check = true as every addition may be an overwrite.
+        AddCoins(inputs, *tx, pindex->nHeight, true);
+    }
+    return true;
+}
+
+bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
+{
+    LOCK(cs_main);
+
+    CCoinsViewCache cache(view);
+
+    std::vector<uint256> hashHeads = view->GetHeadBlocks();
+    if (hashHeads.empty()) return true; // We're already in a consistent state.
+    if (hashHeads.size() != 2) return error("ReplayBlocks(): unknown inconsistent state");
+
+    uiInterface.ShowProgress(_("Replaying blocks..."), 0);
+    LogPrintf("Replaying blocks\n");
+
+    const CBlockIndex* pindexOld = NULL;  // Old tip during the interrupted flush.
+    const CBlockIndex* pindexNew;         // New tip during the interrupted flush.
+    const CBlockIndex* pindexFork = NULL; // Latest block common to both the old and the new tip.
+
+    if (mapBlockIndex.count(hashHeads[0]) == 0) {
+        return error("ReplayBlocks(): reorganization to unknown block requested");
+    }
+    pindexNew = mapBlockIndex[hashHeads[0]];
+
+    if (!hashHeads[1].IsNull()) { // The old tip is allowed to be 0, indicating it's the first flush.
+        if (mapBlockIndex.count(hashHeads[1]) == 0) {
+            return error("ReplayBlocks(): reorganization from unknown block requested");
+        }
+        pindexOld = mapBlockIndex[hashHeads[1]];
+        pindexFork = LastCommonAncestor(pindexOld, pindexNew);
+        assert(pindexFork != NULL);
+    }
+
+    // Rollback along the old branch.
+    while (pindexOld != pindexFork) {
+        if (pindexOld->nHeight > 0) { // Never disconnect the genesis block.
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexOld, params.GetConsensus(pindexOld->nHeight))) {
+                return error("RollbackBlock(): ReadBlockFromDisk() failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+            }
+            LogPrintf("Rolling back %s (%i)\n", pindexOld->GetBlockHash().ToString(), pindexOld->nHeight);
+            CValidationState state;
+            bool fClean = true;
+            cache.SetBestBlock(pindexOld->GetBlockHash());
+            if (!DisconnectBlock(block, state, pindexOld, cache, &fClean)) {
+                return error("RollbackBlock(): DisconnectBlock failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+            }
+            // An unclean disconnect means a non-existing UTXO was deleted, or an existing UTXO was
+            // overwritten. It corresponds to cases where the block-to-be-disconnect never had all its operations
+            // applied to the UTXO set. However, as both writing a UTXO and deleting a UTXO are idempotent operations,
+            // the result is still a version of the UTXO set with the effects of that block undone.
+        }
+        pindexOld = pindexOld->pprev;
+    }
+
+    // Roll forward from the forking point to the new tip.
+    int nForkHeight = pindexFork ? pindexFork->nHeight : 0;
+    for (int nHeight = nForkHeight + 1; nHeight <= pindexNew->nHeight; ++nHeight) {
+        const CBlockIndex* pindex = pindexNew->GetAncestor(nHeight);
+        LogPrintf("Rolling forward %s (%i)\n", pindex->GetBlockHash().ToString(), nHeight);
+        if (!RollforwardBlock(pindex, cache, params)) return false;
+    }
+
+    cache.SetBestBlock(pindexNew->GetBlockHash());
+    cache.Flush();
+    uiInterface.ShowProgress("", 100);
+    return true;
+}
+
 bool RewindBlockIndex(const CChainParams& params)
 {
     LOCK(cs_main);
@@ -3863,6 +4694,9 @@ void UnloadBlockIndex()
     pindexBestHeader = NULL;
     mempool.clear();
     mapBlocksUnlinked.clear();
+    mapBlocksUnknownParent.clear();
+    nBlocksUnknownParentSize = 0;
+    blockFileMap.Clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     nBlockSequenceId = 1;
@@ -3877,9 +4711,30 @@ void UnloadBlockIndex()
         delete entry.second;
     }
     mapBlockIndex.clear();
+    auxpowCache.Clear();
     fHavePruned = false;
 }
 
+bool InitUTXOCommitment()
+{
+    LOCK(cs_main);
+    CCoinsSetHash hashSet;
+    if (chainActive.Tip() == NULL || pblocktree->ReadUTXOCommitment(chainActive.Tip()->GetBlockHash(), hashSet))
+        return true;
+
+    // Commitments of later blocks chain on from this one
+    LogPrintf("Computing the UTXO set commitment...\n");
+    FlushStateToDisk();
+    std::unique_ptr<CCoinsViewDBSnapshot> snapshot(pcoinsdbview->Snapshot());
+    CCoinsStats stats;
+    if (!snapshot || !snapshot->GetStats(stats))
+        return error("%s: failed to read the UTXO set", __func__);
+    if (!pblocktree->WriteUTXOCommitment(stats.hashBlock, stats.hashSet))
+        return error("%s: failed to write the UTXO set commitment", __func__);
+    LogPrintf("%s: UTXO set commitment at block %s: %s\n", __func__, stats.hashBlock.ToString(), stats.hashSet.GetHash().ToString());
+    return true;
+}
+
 bool LoadBlockIndex(const CChainParams& chainparams)
 {
     // Load block index from databases
@@ -3896,9 +4751,17 @@ bool InitBlockIndex(const CChainParams& chainparams)
     if (chainActive.Genesis() != NULL)
         return true;
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
+    // Use the provided settings for -addressindex and -spentindex in the new
+    // database. The chain is connected from scratch, so drop whatever is left
+    // of an index kept before.
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    if (fAddressIndex && !pblocktree->EraseAddressIndex())
+        return error("%s: failed to erase address index", __func__);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    if (fSpentIndex && !pblocktree->EraseSpentIndex())
+        return error("%s: failed to erase spent index", __func__);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -3926,10 +4789,152 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+/**
+ * Reader stage of LoadExternalBlockFile: locate the next block records and
+ * read them raw, leaving deserialization to the check threads.
+ * Sets fEnd once no further block header can be found.
+ */
+static void ReadImportBatch(const CChainParams& chainparams, CBufferedFile& blkdat, uint64_t& nRewind, const CDiskBlockPos* dbp, std::vector<CImportBlock>& vBatch, bool& fEnd)
+{
+    size_t nBatchSize = 0;
+    while (!blkdat.eof() && vBatch.size() < IMPORT_BATCH_BLOCKS && nBatchSize < IMPORT_BATCH_SIZE) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            fEnd = true;
+            return;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            CImportBlock import;
+            import.ssData.resize(nSize);
+            blkdat.read(&import.ssData[0], nSize);
+            nRewind = blkdat.GetPos();
+            if (dbp) {
+                import.pos = CDiskBlockPos(dbp->nFile, nBlockPos);
+                import.fHavePos = true;
+            }
+            vBatch.push_back(std::move(import));
+            nBatchSize += nSize;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    if (blkdat.eof())
+        fEnd = true;
+}
+
+/**
+ * Ordered stage of LoadExternalBlockFile: store a block and the earlier
+ * read blocks waiting for it.  Returns false if the import has to stop.
+ */
+static bool ImportBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, const CDiskBlockPos* dbp, size_t nSize, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        CImportOrphan orphan;
+        orphan.fHavePos = dbp != NULL;
+        if (dbp)
+            orphan.pos = *dbp;
+        orphan.nSize = 0;
+        LOCK(cs_main);
+        if (nBlocksUnknownParentSize + nSize <= MAX_IMPORT_UNKNOWN_PARENT_SIZE) {
+            orphan.pblock = pblock;
+            orphan.nSize = nSize;
+            nBlocksUnknownParentSize += nSize;
+        } else if (!dbp) {
+            return true; // No room to keep it, and no way to read it back
+        }
+        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, orphan));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        LOCK(cs_main);
+        CValidationState state;
+        if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus(0).hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        LOCK(cs_main);
+        std::pair<std::multimap<uint256, CImportOrphan>::iterator, std::multimap<uint256, CImportOrphan>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CImportOrphan>::iterator it = range.first;
+            std::shared_ptr<const CBlock> pblockrecursive = it->second.pblock;
+            if (!pblockrecursive) {
+                std::shared_ptr<CBlock> pblockread = std::make_shared<CBlock>();
+                // TODO: Need a valid consensus height
+                if (ReadBlockFromDisk(*pblockread, it->second.pos, chainparams.GetConsensus(0)))
+                    pblockrecursive = pblockread;
+            }
+            if (pblockrecursive)
+            {
+                LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                        head.ToString());
+                CValidationState dummy;
+                if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, it->second.fHavePos ? &it->second.pos : NULL, NULL))
+                {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            nBlocksUnknownParentSize -= it->second.nSize;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -3937,104 +4942,47 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+
+        // Blocks move through the import in batches: while the check threads
+        // deserialize and check one batch, the previous batch is stored in
+        // file order and the next one is read.
+        std::vector<CImportBlock> vReading, vChecking, vStoring;
+        bool fEnd = false;
+        bool fStop = false;
+        ReadImportBatch(chainparams, blkdat, nRewind, dbp, vChecking, fEnd);
+        while (!fStop && (!vChecking.empty() || !vStoring.empty())) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            CCheckQueueControl<CBlockImportCheck> control(nScriptCheckThreads ? &blockimportqueue : NULL);
+            std::vector<CBlockImportCheck> vChecks;
+            vChecks.reserve((vChecking.size() + IMPORT_CHECK_RANGE - 1) / IMPORT_CHECK_RANGE);
+            for (size_t i = 0; i < vChecking.size(); i += IMPORT_CHECK_RANGE) {
+                const size_t nEnd = std::min(vChecking.size(), i + IMPORT_CHECK_RANGE);
+                vChecks.push_back(CBlockImportCheck(&vChecking[i], &vChecking[0] + nEnd, chainparams.GetConsensus(0)));
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            control.Add(vChecks);
+
+            for (const CImportBlock& import : vStoring) {
+                if (!import.pblock)
                     continue;
+                size_t nSize = ::GetSerializeSize(*import.pblock, SER_DISK, CLIENT_VERSION);
+                if (!ImportBlock(chainparams, import.pblock, import.fHavePos ? &import.pos : NULL, nSize, nLoaded)) {
+                    fStop = true;
+                    break;
                 }
+            }
+            vStoring.clear();
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+            if (!fStop && !fEnd)
+                ReadImportBatch(chainparams, blkdat, nRewind, dbp, vReading, fEnd);
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus(0).hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
+            // Without check threads, the jobs were not handed to a queue.
+            control.Wait();
+            for (CBlockImportCheck& check : vChecks)
+                check();
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        // TODO: Need a valid consensus height
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus(0)))
-                        {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
-            }
+            vStoring.swap(vChecking);
+            vChecking.swap(vReading);
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
@@ -4254,6 +5202,9 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+/** Number of transactions LoadMempool verifies in one batch */
+static const size_t LOAD_MEMPOOL_BATCH = 1000;
+
 bool LoadMempool(void)
 {
     int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
@@ -4278,29 +5229,42 @@ bool LoadMempool(void)
         uint64_t num;
         file >> num;
         double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+        while (num) {
+            // Read a batch, so that its scripts can be verified on all
+            // script check threads before the transactions are accepted
+            std::vector<CTransactionRef> vtx;
+            std::vector<int64_t> vTime;
+            while (num && vtx.size() < LOAD_MEMPOOL_BATCH) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+                num--;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vtx.push_back(tx);
+                    vTime.push_back(nTime);
+                } else {
+                    ++skipped;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+            PreVerifyTransactions(mempool, vtx);
+
+            for (size_t i = 0; i < vtx.size(); i++) {
+                CValidationState state;
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime);
+                AcceptToMemoryPoolWithTime(mempool, state, vtx[i], true, NULL, vTime[i]);
                 if (state.IsValid()) {
                     ++count;
                 } else {
                     ++failed;
                 }
-            } else {
-                ++skipped;
             }
             if (ShutdownRequested())
                 return false;
@@ -4367,6 +5331,93 @@ void DumpMempool(void)
     }
 }
 
+static const uint64_t SCRIPT_CACHE_DUMP_VERSION = 1;
+
+static void WriteCacheEntries(CAutoFile& file, const uint256& nonce, const std::vector<uint256>& vEntries)
+{
+    file << nonce;
+    file << (uint64_t)vEntries.size();
+    for (const uint256& entry : vEntries)
+        file << entry;
+}
+
+static void ReadCacheEntries(CAutoFile& file, uint256& nonce, std::vector<uint256>& vEntries)
+{
+    file >> nonce;
+    uint64_t num;
+    file >> num;
+    while (num--) {
+        uint256 entry;
+        file >> entry;
+        vEntries.push_back(entry);
+    }
+}
+
+bool LoadScriptCaches(void)
+{
+    FILE* filestr = fopen((GetDataDir() / "scriptcache.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open script cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SCRIPT_CACHE_DUMP_VERSION) {
+            return false;
+        }
+        // The entries are only valid with the salt they were computed with,
+        // so the caches take over the salts from the file.
+        uint256 nonceSig, nonceScript;
+        std::vector<uint256> vSigEntries, vScriptEntries;
+        ReadCacheEntries(file, nonceSig, vSigEntries);
+        ReadCacheEntries(file, nonceScript, vScriptEntries);
+        SetSignatureCacheEntries(nonceSig, vSigEntries);
+        scriptExecutionCache.SetEntries(nonceScript, vScriptEntries);
+        LogPrintf("Imported script caches from disk: %u signatures, %u transactions\n", vSigEntries.size(), vScriptEntries.size());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize script cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+void DumpScriptCaches(void)
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 nonceSig, nonceScript;
+    std::vector<uint256> vSigEntries, vScriptEntries;
+    GetSignatureCacheEntries(nonceSig, vSigEntries);
+    scriptExecutionCache.GetEntries(nonceScript, vScriptEntries);
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "scriptcache.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = SCRIPT_CACHE_DUMP_VERSION;
+        file << version;
+        WriteCacheEntries(file, nonceSig, vSigEntries);
+        WriteCacheEntries(file, nonceScript, vScriptEntries);
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "scriptcache.dat.new", GetDataDir() / "scriptcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped script caches: %gs to copy, %gs to dump\n", (mid-start)*0.000001, (last-mid)*0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump script caches: %s. Continuing anyway.\n", e.what());
+    }
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
     if (pindex == NULL)
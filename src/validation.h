@@ -32,12 +32,15 @@
 #include <boost/unordered_map.hpp>
 #include <boost/filesystem/path.hpp>
 
+class CBlockHeader;
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
 class CConnman;
+class CPubKeyParseCache;
 class CScriptCheck;
 class CTxMemPool;
 class CValidationInterface;
@@ -134,6 +137,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -utxocommitment */
+static const bool DEFAULT_UTXO_COMMITMENT = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -mempoolreplacement */
@@ -169,6 +174,9 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern bool fUTXOCommitment;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -260,12 +268,30 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
+/** Compute the UTXO set commitment of the tip from the coin database, unless it is kept already */
+bool InitUTXOCommitment();
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex(const CChainParams& chainparams);
+/** Update the chain tip based on database information. */
+void LoadChainTip(const CChainParams& chainparams);
+/** Replay blocks that aren't fully applied to the database. */
+bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header checking thread */
+void ThreadHeaderCheck();
+/** Run an instance of the block import check thread */
+void ThreadBlockImportCheck();
+/** Run an instance of the thread reading a block's inputs ahead of ConnectBlock */
+void ThreadCoinsPrefetch();
+/** Run an instance of the thread verifying transactions ahead of AcceptToMemoryPool */
+void ThreadTxPreVerify();
+/** Run the thread writing chainstate flushes to the coins database in the background */
+void ThreadFlushCoins();
+/** Run the thread building the transaction index in the background */
+void ThreadTxIndex();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -335,6 +361,17 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced = NULL,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/**
+ * Verify the scripts of transactions about to be passed to AcceptToMemoryPool
+ * without holding cs_main, and store the results in the signature and script
+ * execution caches, so that AcceptToMemoryPool only has to look them up.
+ * cs_main and pool.cs are only held while the spent outputs are looked up.
+ * Transactions AcceptToMemoryPool would reject before verifying the scripts
+ * are skipped. A single transaction is verified by the calling thread, a
+ * batch on the script check threads.
+ */
+void PreVerifyTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -372,10 +409,16 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. If pubkeycache is not NULL, the script checks share the
+ * public keys parsed in it. If cacheFullScriptStore is set and the scripts are run inline, a
+ * successful result is kept in the script execution cache; otherwise cache hits are removed.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
+                 std::vector<CScriptCheck> *pvChecks = NULL, CPubKeyParseCache *pubkeycache = NULL);
+
+/** Initializes the script execution cache */
+void InitScriptExecutionCache();
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -450,12 +493,13 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    CPubKeyParseCache *pubkeycache;
 
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pubkeycache(NULL) {}
+    CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn, CPubKeyParseCache* pubkeycacheIn = NULL) :
+        scriptPubKey(scriptPubKeyIn), amount(amountIn),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pubkeycache(pubkeycacheIn) { }
 
     bool operator()();
 
@@ -468,17 +512,51 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pubkeycache, check.pubkeycache);
     }
 
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the context-free checks (chain ID, auxpow and scrypt
+ * proof of work) of a contiguous range of block headers.  These do not need
+ * cs_main, so ProcessNewBlockHeaders runs them on the header check queue
+ * before accepting the headers.
+ */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader *pbegin;
+    const CBlockHeader *pend;
+    const Consensus::Params *params;
+    //! One flag per header in the range, set if that header failed
+    char *pfInvalid;
+
+public:
+    CHeaderCheck(): pbegin(NULL), pend(NULL), params(NULL), pfInvalid(NULL) {}
+    CHeaderCheck(const CBlockHeader *pbeginIn, const CBlockHeader *pendIn, const Consensus::Params& paramsIn, char *pfInvalidIn) :
+        pbegin(pbeginIn), pend(pendIn), params(&paramsIn), pfInvalid(pfInvalidIn) { }
+
+    bool operator()();
+
+    void swap(CHeaderCheck &check) {
+        std::swap(pbegin, check.pbegin);
+        std::swap(pend, check.pend);
+        std::swap(params, check.params);
+        std::swap(pfInvalid, check.pfInvalid);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+/** Read the serialized block of pindex as stored on disk, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const uint256& hash);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -501,8 +579,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. The indexes kept alongside
+ *  the chain are only unwound if fUpdateIndexes is set. */
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, bool fUpdateIndexes = false);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
@@ -542,6 +621,9 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/** Global variable that points to the coins database (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
@@ -577,6 +659,12 @@ static const unsigned int REJECT_CONFLICT = 0x102;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
+/** Dump the signature and script execution caches to disk. */
+void DumpScriptCaches();
+
+/** Load the signature and script execution caches from disk. */
+bool LoadScriptCaches();
+
 /** Dump the mempool to disk. */
 void DumpMempool();
 